@@ -0,0 +1,477 @@
+/*
+    Copyright 2018 Antonio Lassandro
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+/*
+    Benchmarks for juce_vector. Build the Release configuration and run with
+    the names of the benchmarks to run, or with no arguments to run them all.
+*/
+
+#pragma mark -
+// =============================================================================
+
+namespace
+{
+    void print(const juce::String &line)
+    {
+        std::cout << line << std::endl;
+    }
+
+    // A cheap per-thread generator, so the benchmarks measure the code under
+    // test rather than a shared random number generator
+    struct XorShift
+    {
+        explicit XorShift(juce::uint64 seed)
+        : state(seed * 0x9e3779b97f4a7c15ULL + 1)
+        {
+        }
+
+        juce::uint64 next()
+        {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return state;
+        }
+
+        juce::uint64 state;
+    };
+
+    /*
+        Runs body(threadIndex) on numThreads threads at once, and returns the
+        seconds taken from starting them all to the last one finishing.
+    */
+    template <typename Body>
+    double runThreads(int numThreads, Body body)
+    {
+        std::atomic<int> numReady { 0 };
+        std::atomic<bool> go { false };
+        std::vector<std::thread> threads;
+
+        for (int i = 0; i < numThreads; ++i)
+        {
+            threads.emplace_back([&, i]
+            {
+                ++numReady;
+
+                while (! go.load())
+                    std::this_thread::yield();
+
+                body(i);
+            });
+        }
+
+        while (numReady.load() < numThreads)
+            std::this_thread::yield();
+
+        const auto start = juce::Time::getMillisecondCounterHiRes();
+        go = true;
+
+        for (auto &t : threads)
+            t.join();
+
+        return (juce::Time::getMillisecondCounterHiRes() - start) / 1000.0;
+    }
+}
+
+#pragma mark -
+// =============================================================================
+
+/*
+    Measures how SVGSharedCache lookups scale as more threads share one cache,
+    against the same workload on a HashMap behind a CriticalSection.
+
+    Every thread reads random keys from a warm cache and replaces a few of
+    them, which is what exporter threads sharing an EncodedImageCache do.
+*/
+static void benchmarkSharedCache()
+{
+    constexpr int numKeys = 4096;
+    constexpr int numOpsPerThread = 1000000;
+    constexpr int setsPerThousand = 20;
+
+    const juce::String value = juce::String::repeatedString("x", 4096);
+
+    struct LockedCache
+    {
+        bool get(juce::uint64 key, juce::String &result)
+        {
+            const juce::ScopedLock sl(lock);
+
+            if (! map.contains(key))
+                return false;
+
+            result = map[key];
+            return true;
+        }
+
+        void set(juce::uint64 key, const juce::String &v)
+        {
+            const juce::ScopedLock sl(lock);
+            map.set(key, v);
+        }
+
+        juce::CriticalSection lock;
+        juce::HashMap<juce::uint64, juce::String> map { numKeys };
+    };
+
+    print("shared-cache: " + juce::String(numOpsPerThread) + " operations "
+          + "per thread, " + juce::String(setsPerThousand / 10.0, 1) + "% sets");
+    print("threads   SVGSharedCache (Mops/s)   locked HashMap (Mops/s)");
+
+    for (int numThreads : { 1, 2, 4, 8 })
+    {
+        SVGSharedCache<juce::String> cache(numKeys * 8192);
+        LockedCache locked;
+
+        for (int k = 0; k < numKeys; ++k)
+        {
+            cache.set((juce::uint64) k, value, (size_t) value.length());
+            locked.set((juce::uint64) k, value);
+        }
+
+        auto run = [&](auto &target, auto set)
+        {
+            const auto seconds = runThreads(numThreads, [&](int threadIndex)
+            {
+                XorShift random((juce::uint64) threadIndex + 1);
+                juce::String result;
+
+                for (int i = 0; i < numOpsPerThread; ++i)
+                {
+                    const auto r = random.next();
+                    const auto key = r % numKeys;
+
+                    if ((r >> 32) % 1000 < setsPerThousand)
+                        set(target, key);
+                    else
+                        target.get(key, result);
+                }
+            });
+
+            return (double) numThreads * numOpsPerThread / seconds / 1.0e6;
+        };
+
+        const auto sharedRate = run(cache, [&](SVGSharedCache<juce::String> &c, juce::uint64 key)
+        {
+            c.set(key, value, (size_t) value.length());
+        });
+
+        const auto lockedRate = run(locked, [&](LockedCache &c, juce::uint64 key)
+        {
+            c.set(key, value);
+        });
+
+        print(juce::String(numThreads).paddedRight(' ', 10)
+              + juce::String(sharedRate, 2).paddedRight(' ', 26)
+              + juce::String(lockedRate, 2));
+    }
+}
+
+#pragma mark -
+// =============================================================================
+
+/*
+    Measures what each PrecisionPolicy costs in output size, and what it
+    saves in coordinate error.
+
+    A canvas of random curved paths is drawn at a few context scales. Every
+    number in the written path data is then compared with the coordinate it
+    came from, with the difference measured in output pixels.
+*/
+static void benchmarkPrecision()
+{
+    constexpr int width  = 4000;
+    constexpr int height = 3000;
+    constexpr int numPaths = 500;
+    constexpr int numSegments = 40;
+
+    using Policy = LowLevelGraphicsSVGRenderer::PrecisionPolicy;
+
+    const std::pair<const char*, Policy> policies[] =
+    {
+        { "decimalPlaces(0)",     Policy::decimalPlaces(0) },
+        { "decimalPlaces(1)",     Policy::decimalPlaces(1) },
+        { "decimalPlaces(2)",     Policy::decimalPlaces(2) },
+        { "decimalPlaces(3)",     Policy::decimalPlaces(3) },
+        { "significantDigits(4)", Policy::significantDigits(4) },
+        { "significantDigits(5)", Policy::significantDigits(5) },
+        { "automatic(0.5)",       Policy::automatic(0.5f) },
+        { "automatic(0.05)",      Policy::automatic(0.05f) },
+        { "automatic(0.005)",     Policy::automatic(0.005f) },
+    };
+
+    print("precision: " + juce::String(numPaths) + " paths of "
+          + juce::String(numSegments) + " curves on a "
+          + juce::String(width) + "x" + juce::String(height) + " canvas");
+
+    for (float scale : { 1.0f, 4.0f })
+    {
+        // The paths are drawn in the context's coordinates, so they cover
+        // the same output area at every scale
+        juce::Random random(1);
+        juce::Array<juce::Path> paths;
+
+        for (int i = 0; i < numPaths; ++i)
+        {
+            auto randomPoint = [&]
+            {
+                return juce::Point<float>(
+                    random.nextFloat() * width / scale,
+                    random.nextFloat() * height / scale
+                );
+            };
+
+            juce::Path p;
+            p.startNewSubPath(randomPoint());
+
+            for (int s = 0; s < numSegments; ++s)
+                p.cubicTo(randomPoint(), randomPoint(), randomPoint());
+
+            p.closeSubPath();
+            paths.add(p);
+        }
+
+        print({});
+        print("scale " + juce::String(scale, 1));
+        print("policy                  bytes       max error (px)   mean error (px)");
+
+        for (const auto &policy : policies)
+        {
+            juce::XmlElement svg("svg");
+            juce::MemoryOutputStream output;
+
+            {
+                LowLevelGraphicsSVGRenderer renderer(&svg, width, height);
+                renderer.setPrecisionPolicy(policy.second);
+                renderer.addTransform(juce::AffineTransform::scale(scale));
+
+                for (const auto &p : paths)
+                    renderer.fillPath(p, {});
+
+                renderer.writeSnapshot(output);
+            }
+
+            // Path data is written as absolute commands, so its numbers are
+            // the path's coordinates in order
+            juce::Array<float> expected;
+
+            for (const auto &p : paths)
+            {
+                juce::Path::Iterator i(p);
+
+                while (i.next())
+                {
+                    if (i.elementType == juce::Path::Iterator::closePath)
+                        continue;
+
+                    expected.add(i.x1);
+                    expected.add(i.y1);
+
+                    if (i.elementType == juce::Path::Iterator::cubicTo)
+                    {
+                        expected.add(i.x2); expected.add(i.y2);
+                        expected.add(i.x3); expected.add(i.y3);
+                    }
+                }
+            }
+
+            juce::Array<float> written;
+
+            std::function<void(const juce::XmlElement&)> collect = [&](const juce::XmlElement &e)
+            {
+                if (e.hasTagName("path"))
+                {
+                    juce::StringArray tokens;
+                    tokens.addTokens(e.getStringAttribute("d"), " ", {});
+
+                    for (const auto &token : tokens)
+                        if (! juce::CharacterFunctions::isLetter(token[0]))
+                            written.add(token.getFloatValue());
+                }
+
+                forEachXmlChildElement(e, child)
+                    collect(*child);
+            };
+
+            collect(svg);
+
+            if (written.size() != expected.size())
+            {
+                print(juce::String(policy.first).paddedRight(' ', 24)
+                      + "path data doesn't match the paths drawn");
+                continue;
+            }
+
+            double maxError = 0.0, totalError = 0.0;
+
+            for (int i = 0; i < written.size(); ++i)
+            {
+                auto error = std::abs((double) written[i] - expected[i]) * scale;
+                maxError = juce::jmax(maxError, error);
+                totalError += error;
+            }
+
+            print(juce::String(policy.first).paddedRight(' ', 24)
+                  + juce::String((juce::int64) output.getDataSize()).paddedRight(' ', 12)
+                  + juce::String(maxError, 5).paddedRight(' ', 17)
+                  + juce::String(totalError / written.size(), 5));
+        }
+    }
+}
+
+#pragma mark -
+// =============================================================================
+
+/*
+    Measures how long a large document takes to write through a
+    SVGMappedFileOutputStream, against a juce::FileOutputStream.
+
+    Each document is written a few times to each stream in turn, and the
+    fastest time for each is kept so that one slow write to a cold disk
+    doesn't decide the result. The time includes closing the file.
+*/
+static void benchmarkMappedOutput()
+{
+    constexpr int numSegments = 20;
+    constexpr int numRepeats = 5;
+
+    print("mapped-output: fastest of " + juce::String(numRepeats)
+          + " writes of each document");
+    print("size (MB)   FileOutputStream (ms)   SVGMappedFileOutputStream (ms)");
+
+    const auto file = juce::File::createTempFile(".svg");
+
+    for (int numPaths : { 5000, 20000, 80000 })
+    {
+        juce::XmlElement svg("svg");
+
+        {
+            LowLevelGraphicsSVGRenderer renderer(&svg, 4000, 3000);
+            juce::Random random(1);
+
+            for (int i = 0; i < numPaths; ++i)
+            {
+                auto randomPoint = [&]
+                {
+                    return juce::Point<float>(
+                        random.nextFloat() * 4000.0f,
+                        random.nextFloat() * 3000.0f
+                    );
+                };
+
+                juce::Path p;
+                p.startNewSubPath(randomPoint());
+
+                for (int s = 0; s < numSegments; ++s)
+                    p.cubicTo(randomPoint(), randomPoint(), randomPoint());
+
+                renderer.fillPath(p, {});
+            }
+        }
+
+        double streamTime = 0.0, mappedTime = 0.0;
+
+        for (int r = 0; r < numRepeats; ++r)
+        {
+            {
+                file.deleteFile();
+
+                const auto start = juce::Time::getMillisecondCounterHiRes();
+
+                {
+                    juce::FileOutputStream out(file);
+                    svg.writeToStream(out, juce::String());
+                }
+
+                const auto time = juce::Time::getMillisecondCounterHiRes() - start;
+                streamTime = r == 0 ? time : juce::jmin(streamTime, time);
+            }
+
+            {
+                const auto start = juce::Time::getMillisecondCounterHiRes();
+
+                {
+                    SVGMappedFileOutputStream out(file);
+                    svg.writeToStream(out, juce::String());
+                    out.finish();
+                }
+
+                const auto time = juce::Time::getMillisecondCounterHiRes() - start;
+                mappedTime = r == 0 ? time : juce::jmin(mappedTime, time);
+            }
+        }
+
+        const auto size = (double) file.getSize() / (1024.0 * 1024.0);
+
+        print(juce::String(size, 1).paddedRight(' ', 12)
+              + juce::String(streamTime, 1).paddedRight(' ', 24)
+              + juce::String(mappedTime, 1));
+    }
+
+    file.deleteFile();
+}
+
+#pragma mark -
+// =============================================================================
+
+namespace
+{
+    struct Benchmark
+    {
+        const char *name;
+        void (*run)();
+    };
+
+    const Benchmark benchmarks[] =
+    {
+        { "shared-cache",  benchmarkSharedCache },
+        { "precision",     benchmarkPrecision },
+        { "mapped-output", benchmarkMappedOutput },
+    };
+}
+
+int main(int argc, char *argv[])
+{
+    juce::StringArray names;
+
+    for (int i = 1; i < argc; ++i)
+        names.add(argv[i]);
+
+    for (const auto &benchmark : benchmarks)
+    {
+        if (names.isEmpty() || names.contains(benchmark.name))
+        {
+            benchmark.run();
+            print({});
+        }
+    }
+
+    return 0;
+}
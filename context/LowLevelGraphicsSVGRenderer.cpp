@@ -20,36 +20,212 @@
     IN THE SOFTWARE.
 */
 
+#if JUCE_VECTOR_ENABLE_INSTRUMENTATION
+ #define JUCE_VECTOR_INSTRUMENT(operation) \
+    const ScopedOperation scopedOperation(*this, Stats::operation);
+#else
+ #define JUCE_VECTOR_INSTRUMENT(operation)
+#endif
+
+#pragma mark -
+// =============================================================================
+
+// Attribute names are interned once, rather than being looked up in the
+// string pool by every setAttribute() call
+namespace SVGIds
+{
+    static const juce::Identifier clipPath            ("clip-path");
+    static const juce::Identifier cx                  ("cx");
+    static const juce::Identifier cy                  ("cy");
+    static const juce::Identifier d                   ("d");
+    static const juce::Identifier dataCodec           ("data-codec");
+    static const juce::Identifier dominantBaseline    ("dominant-baseline");
+    static const juce::Identifier end                 ("end");
+    static const juce::Identifier fill                ("fill");
+    static const juce::Identifier fillOpacity         ("fill-opacity");
+    static const juce::Identifier fillRule            ("fill-rule");
+    static const juce::Identifier fontFamily          ("font-family");
+    static const juce::Identifier fontSize            ("font-size");
+    static const juce::Identifier fontStyle           ("font-style");
+    static const juce::Identifier fx                  ("fx");
+    static const juce::Identifier fy                  ("fy");
+    static const juce::Identifier gradientTransform   ("gradientTransform");
+    static const juce::Identifier gradientUnits       ("gradientUnits");
+    static const juce::Identifier height              ("height");
+    static const juce::Identifier id                  ("id");
+    static const juce::Identifier imageRendering      ("image-rendering");
+    static const juce::Identifier lengthAdjust        ("lengthAdjust");
+    static const juce::Identifier mask                ("mask");
+    static const juce::Identifier offset              ("offset");
+    static const juce::Identifier opacity             ("opacity");
+    static const juce::Identifier patternTransform    ("patternTransform");
+    static const juce::Identifier patternUnits        ("patternUnits");
+    static const juce::Identifier preserveAspectRatio ("preserveAspectRatio");
+    static const juce::Identifier r                   ("r");
+    static const juce::Identifier start               ("start");
+    static const juce::Identifier stopColor           ("stop-color");
+    static const juce::Identifier stopOpacity         ("stop-opacity");
+    static const juce::Identifier stroke              ("stroke");
+    static const juce::Identifier strokeOpacity       ("stroke-opacity");
+    static const juce::Identifier strokeWidth         ("stroke-width");
+    static const juce::Identifier textAnchor          ("text-anchor");
+    static const juce::Identifier textLength          ("textLength");
+    static const juce::Identifier transform           ("transform");
+    static const juce::Identifier viewBox             ("viewBox");
+    static const juce::Identifier width               ("width");
+    static const juce::Identifier x                   ("x");
+    static const juce::Identifier x1                  ("x1");
+    static const juce::Identifier x2                  ("x2");
+    static const juce::Identifier xlinkHref           ("xlink:href");
+    static const juce::Identifier xmlns               ("xmlns");
+    static const juce::Identifier xmlnsXlink          ("xmlns:xlink");
+    static const juce::Identifier y                   ("y");
+    static const juce::Identifier y1                  ("y1");
+    static const juce::Identifier y2                  ("y2");
+}
+
+#pragma mark -
+// =============================================================================
+
+LowLevelGraphicsSVGRenderer::DefaultImageCodecPolicy::DefaultImageCodecPolicy(
+    float jpegQuality,
+    int maxPNGColours)
+{
+    quality    = jpegQuality;
+    maxColours = maxPNGColours;
+}
+
+LowLevelGraphicsSVGRenderer::ImageCodec
+LowLevelGraphicsSVGRenderer::DefaultImageCodecPolicy::getCodecForImage(
+    const juce::Image &i,
+    bool isMask)
+{
+    if (isMask)
+        return ImageCodec::singleChannelPNG;
+
+    if (i.isSingleChannel())
+        return ImageCodec::png;
+
+    const juce::Image::BitmapData bitmap(i, 0, 0, i.getWidth(), i.getHeight());
+
+    // JPEG would drop the alpha channel, so every pixel is checked here rather
+    // than just the sampled ones
+    if (i.isARGB())
+    {
+        for (int y = 0; y < bitmap.height; ++y)
+        {
+            auto pixel = bitmap.getLinePointer(y) + juce::PixelARGB::indexA;
+
+            for (int x = 0; x < bitmap.width; ++x, pixel += bitmap.pixelStride)
+                if (*pixel != 0xff)
+                    return ImageCodec::png;
+        }
+    }
+
+    const int samplesPerAxis = 32;
+
+    auto stepX = juce::jmax(1, bitmap.width  / samplesPerAxis);
+    auto stepY = juce::jmax(1, bitmap.height / samplesPerAxis);
+
+    juce::Array<juce::uint32> colours;
+
+    for (int y = stepY / 2; y < bitmap.height; y += stepY)
+    {
+        for (int x = stepX / 2; x < bitmap.width; x += stepX)
+        {
+            colours.addIfNotAlreadyThere(bitmap.getPixelColour(x, y).getARGB());
+
+            if (colours.size() > maxColours)
+                return ImageCodec::jpeg;
+        }
+    }
+
+    return ImageCodec::png;
+}
+
+float LowLevelGraphicsSVGRenderer::DefaultImageCodecPolicy::getJPEGQuality()
+{
+    return quality;
+}
+
+#pragma mark -
+// =============================================================================
+
 LowLevelGraphicsSVGRenderer::LowLevelGraphicsSVGRenderer(
     juce::XmlElement *svgDocument,
     int totalWidth,
     int totalHeight)
+    : LowLevelGraphicsSVGRenderer(totalWidth, totalHeight)
+{
+    // XmlElements that don't have the proper name or that already have children
+    // will yield unusable or undefined results
+    jassert(svgDocument->getTagName().toLowerCase() == "svg");
+    jassert(svgDocument->getNumChildElements() == 0);
+
+    output = svgDocument;
+}
+
+LowLevelGraphicsSVGRenderer::LowLevelGraphicsSVGRenderer(
+    int totalWidth,
+    int totalHeight)
 {
     stateStack.add(new SavedState());
     state = stateStack.getLast();
 
     state->clipRegions = juce::Rectangle<int>(totalWidth, totalHeight);
-    state->clipPath = state->clipRegions.toPath();
     state->clipGroup = nullptr;
+    state->topLevelGroup = nullptr;
 
     resampleQuality = juce::Graphics::mediumResamplingQuality;
 
-    document = svgDocument;
+    downsampleImages  = false;
+    imageOversampling = 1.0f;
 
-    // XmlElements that don't have the proper name or that already have children
-    // will yield unusable or undefined results
-    jassert(document->getTagName().toLowerCase() == "svg");
-    jassert(document->getNumChildElements() == 0);
+    pathTolerance = 0.0f;
+
+    canvasSize = (float)juce::jmax(totalWidth, totalHeight);
+
+    indexElements = false;
+
+    contentAddressedIDs = false;
+
+    memoryBudget  = 0;
+    finishedBytes = 0;
+    numDefs       = 0;
+    indexCellSize = 256.0f;
+    indexColumns  = 0;
+    indexRows     = 0;
 
-    document->setAttribute("xmlns", "http://www.w3.org/2000/svg");
-    document->setAttribute("xmlns:xlink", "http://www.w3.org/1999/xlink");
+    codecPolicy.reset(new DefaultImageCodecPolicy());
 
-    document->setAttribute("width", totalWidth);
-    document->setAttribute("height", totalHeight);
+    maxTraceEvents = 100000;
+
+    output   = nullptr;
+    document = nodes.createElement("svg");
+
+    document->setAttribute(SVGIds::xmlns, "http://www.w3.org/2000/svg");
+    document->setAttribute(SVGIds::xmlnsXlink, "http://www.w3.org/1999/xlink");
+
+    document->setAttribute(SVGIds::width, totalWidth);
+    document->setAttribute(SVGIds::height, totalHeight);
 
     document->createNewChildElement("defs");
 }
 
+LowLevelGraphicsSVGRenderer::~LowLevelGraphicsSVGRenderer()
+{
+    if (output)
+        createDocument(output);
+}
+
+void LowLevelGraphicsSVGRenderer::createDocument(juce::XmlElement *svgDocument) const
+{
+    jassert(svgDocument->getTagName().toLowerCase() == "svg");
+    jassert(svgDocument->getNumChildElements() == 0);
+
+    document->copyContentTo(*svgDocument);
+}
+
 #pragma mark -
 // =============================================================================
 
@@ -68,22 +244,52 @@ float LowLevelGraphicsSVGRenderer::getPhysicalPixelScaleFactor()
 
 void LowLevelGraphicsSVGRenderer::setOrigin(juce::Point<int> p)
 {
+    JUCE_VECTOR_INSTRUMENT(setOrigin)
+
+    if (auto hash = hashOp(Stats::setOrigin))
+    {
+        hash->add(p.x);
+        hash->add(p.y);
+    }
+
     if (p.x != state->xOffset || p.y != state->yOffset)
     {
         state->xOffset += p.x;
         state->yOffset += p.y;
-        setClip(state->clipPath);
+        setClip();
     }
 }
 
 void LowLevelGraphicsSVGRenderer::addTransform(const juce::AffineTransform &t)
 {
+    JUCE_VECTOR_INSTRUMENT(addTransform)
+
+    if (auto hash = hashOp(Stats::addTransform))
+        hash->add(t);
+
     state->transform = state->transform.followedBy(t);
 
-    state->clipRegions.transformAll(t);
-    state->clipPath.applyTransform(t);
+    if (!state->clipIsRectangles)
+    {
+        auto path = state->clipPath;
+        path.applyTransform(t);
+
+        switchToPathClip(path, state->clipBounds.transformedBy(t));
+    }
+    else if (t.mat01 != 0.0f || t.mat10 != 0.0f)
+    {
+        // Rotated or sheared rectangles are no longer rectangles
+        auto path = state->clipRegions.toPath();
+        path.applyTransform(t);
+
+        switchToPathClip(path, path.getBounds());
+    }
+    else
+    {
+        state->clipRegions.transformAll(t);
+    }
 
-    setClip(state->clipRegions.toPath());
+    setClip();
 }
 
 #pragma mark -
@@ -91,9 +297,14 @@ void LowLevelGraphicsSVGRenderer::addTransform(const juce::AffineTransform &t)
 
 bool LowLevelGraphicsSVGRenderer::clipToRectangle(const juce::Rectangle<int> &r)
 {
-    state->clipRegions.clipTo(r.translated(state->xOffset, state->yOffset));
+    JUCE_VECTOR_INSTRUMENT(clipToRectangle)
 
-    setClip(state->clipRegions.toPath());
+    if (auto hash = hashOp(Stats::clipToRectangle))
+        hash->add(r);
+
+    switchToRectangleClip();
+    state->clipRegions.clipTo(r.translated(state->xOffset, state->yOffset));
+    setClip();
 
     return !isClipEmpty();
 }
@@ -101,9 +312,14 @@ bool LowLevelGraphicsSVGRenderer::clipToRectangle(const juce::Rectangle<int> &r)
 bool LowLevelGraphicsSVGRenderer::clipToRectangleList(
     const juce::RectangleList<int> &r)
 {
-    state->clipRegions.clipTo(r);
+    JUCE_VECTOR_INSTRUMENT(clipToRectangleList)
+
+    if (auto hash = hashOp(Stats::clipToRectangleList))
+        hash->add(r);
 
-    setClip(state->clipRegions.toPath());
+    switchToRectangleClip();
+    state->clipRegions.clipTo(r);
+    setClip();
 
     return !isClipEmpty();
 }
@@ -111,96 +327,222 @@ bool LowLevelGraphicsSVGRenderer::clipToRectangleList(
 void LowLevelGraphicsSVGRenderer::excludeClipRectangle(
     const juce::Rectangle<int> &r)
 {
-    state->clipRegions.subtract(r.translated(state->xOffset, state->yOffset));
+    JUCE_VECTOR_INSTRUMENT(excludeClipRectangle)
 
-    setClip(state->clipRegions.toPath());
+    if (auto hash = hashOp(Stats::excludeClipRectangle))
+        hash->add(r);
+
+    switchToRectangleClip();
+    state->clipRegions.subtract(r.translated(state->xOffset, state->yOffset));
+    setClip();
 }
 
 void LowLevelGraphicsSVGRenderer::clipToPath(
     const juce::Path &p,
     const juce::AffineTransform &t)
 {
+    JUCE_VECTOR_INSTRUMENT(clipToPath)
+
+    if (auto hash = hashOp(Stats::clipToPath))
+    {
+        hash->add(p);
+        hash->add(t);
+    }
+
+    if (isCulled())
+        return;
+
     auto temp = p;
     temp.applyTransform(t.translated(state->xOffset, state->yOffset));
-    setClip(temp);
+
+    auto pathBounds = temp.getBounds();
+    auto clipBounds = getClipBoundsInternal();
+
+    // Nothing can be drawn through a clip that misses the current one
+    if (!pathBounds.intersects(clipBounds))
+    {
+        state->clipRegions.clear();
+        state->clipIsRectangles = true;
+        return;
+    }
+
+    juce::Rectangle<float> rect;
+
+    if (isRectangle(temp, rect))
+    {
+        // A rectangle covering the whole clip doesn't change it
+        if (rect.contains(clipBounds))
+            return;
+
+        if (state->clipIsRectangles && rect.toNearestInt().toFloat() == rect)
+        {
+            state->clipRegions.clipTo(rect.toNearestInt());
+            setClip();
+            return;
+        }
+    }
+
+    // Otherwise the new clip group is nested inside the current one, which
+    // intersects the two when the document is rendered
+    switchToPathClip(temp, clipBounds.getIntersection(pathBounds));
+    setClip();
 }
 
 void LowLevelGraphicsSVGRenderer::clipToImageAlpha(
     const juce::Image &i,
     const juce::AffineTransform &t)
 {
-    juce::Image maskImage(i);
+    JUCE_VECTOR_INSTRUMENT(clipToImageAlpha)
 
-    if (i.getFormat() != juce::Image::SingleChannel)
-        maskImage = i.convertedToFormat(juce::Image::SingleChannel);
+    // The mask image only depends on the image's alpha channel, so it's shared
+    // between every mask made from the same content
+    auto imageHash = hashImage(i);
 
-    auto defs = document->getChildByName("defs");
-    auto maskRef = juce::String::formatted(
-        "#Mask%d",
-        defs->getNumChildElements()
-    );
+    if (auto hash = hashOp(Stats::clipToImageAlpha))
+    {
+        hash->add(imageHash);
+        hash->add(t);
+    }
 
-    auto mask  = defs->createNewChildElement("mask");
-    mask->setAttribute("id", maskRef.replace("#", ""));
+    if (isCulled())
+        return;
 
-    auto image = mask->createNewChildElement("image");
-    image->setAttribute("x", state->xOffset);
-    image->setAttribute("y", state->yOffset);
-    image->setAttribute("width", i.getWidth());
-    image->setAttribute("height", i.getHeight());
+    auto imageKey = getDefScope()
+        + "Mask_" + juce::String::toHexString((juce::int64)imageHash);
 
-    image->setAttribute("image-rendering", writeImageQuality());
+    if (!imageRefs.contains(imageKey))
+    {
+        auto image = createDef("image", "MaskImage");
+        image->setAttribute(SVGIds::width, i.getWidth());
+        image->setAttribute(SVGIds::height, i.getHeight());
 
-    if (!t.isIdentity())
-        image->setAttribute(
-            "transform",
-            writeTransform(state->transform.followedBy(t))
-        );
+        applyImageData(image, i, true);
 
-    juce::MemoryOutputStream out;
-    juce::PNGImageFormat png;
-    png.writeImageToStream(i, out);
+        imageRefs.set(imageKey, finishDef(image));
+    }
+    else
+    {
+        noteDefReused();
+    }
 
-    auto base64Data = juce::Base64::toBase64(out.getData(), out.getDataSize());
+    auto imageRef = imageRefs[imageKey];
+    auto transform = t.isIdentity()
+        ? juce::String()
+        : writeTransform(state->transform.followedBy(t));
+
+    auto maskKey = getDefScope() + imageRef + juce::String::formatted(
+        "@%d,%d,%d,",
+        state->xOffset,
+        state->yOffset,
+        (int)resampleQuality
+    ) + transform;
+
+    if (!maskRefs.contains(maskKey))
+    {
+        auto mask = createDef("mask", "Mask");
+
+        auto image = mask->createNewChildElement("use");
+        image->setAttribute(SVGIds::x, state->xOffset);
+        image->setAttribute(SVGIds::y, state->yOffset);
+        image->setAttribute(SVGIds::imageRendering, writeImageQuality());
+
+        if (transform.isNotEmpty())
+            image->setAttribute(SVGIds::transform, transform);
+
+        image->setAttribute(SVGIds::xlinkHref, imageRef);
 
-    image->setAttribute("xlink:href", "data:image/png;base64," + base64Data);
+        maskRefs.set(maskKey, finishDef(mask));
+    }
+    else
+    {
+        noteDefReused();
+    }
 
-    state->clipGroup = document->createNewChildElement("g");
-    state->clipGroup->setAttribute("mask", "url(" + maskRef + ")");
+    // The mask group nests inside the current clip group, so it stays inside
+    // any clips, transparency layers and snapshot groups that are open
+    openClipGroup();
+    state->clipGroup->setAttribute(SVGIds::mask, "url(" + maskRefs[maskKey] + ")");
 }
 
 bool LowLevelGraphicsSVGRenderer::clipRegionIntersects(
     const juce::Rectangle<int> &r)
 {
-    auto rect = r.translated(state->xOffset, state->yOffset).toFloat();
-    return state->clipPath.getBounds().intersects(rect);
+    JUCE_VECTOR_INSTRUMENT(clipRegionIntersects)
+
+    auto rect = r.translated(state->xOffset, state->yOffset);
+
+    if (state->clipIsRectangles)
+        return state->clipRegions.intersectsRectangle(rect);
+
+    return state->clipBounds.intersects(rect.toFloat());
 }
 
 juce::Rectangle<int> LowLevelGraphicsSVGRenderer::getClipBounds() const
 {
-    return state->clipPath.getBounds()
-        .translated(-state->xOffset, -state->yOffset).toNearestInt();
+    JUCE_VECTOR_INSTRUMENT(getClipBounds)
+
+    if (state->clipIsRectangles)
+        return state->clipRegions.getBounds()
+            .translated(-state->xOffset, -state->yOffset);
+
+    return state->clipBounds
+        .translated((float)-state->xOffset, (float)-state->yOffset)
+        .getSmallestIntegerContainer();
 }
 
 bool LowLevelGraphicsSVGRenderer::isClipEmpty() const
 {
-    return state->clipPath.isEmpty();
+    JUCE_VECTOR_INSTRUMENT(isClipEmpty)
+
+    if (state->clipIsRectangles)
+        return state->clipRegions.isEmpty();
+
+    return state->clipBounds.isEmpty();
 }
 
 #pragma mark -
 // =============================================================================
 
 void LowLevelGraphicsSVGRenderer::saveState()
+{
+    JUCE_VECTOR_INSTRUMENT(saveState)
+
+    hashOp(Stats::saveState);
+
+    pushState();
+}
+
+void LowLevelGraphicsSVGRenderer::restoreState()
+{
+    JUCE_VECTOR_INSTRUMENT(restoreState)
+
+    hashOp(Stats::restoreState);
+
+    popState();
+}
+
+void LowLevelGraphicsSVGRenderer::pushState()
 {
     stateStack.add(new SavedState(*stateStack.getLast()));
     state = stateStack.getLast();
 }
 
-void LowLevelGraphicsSVGRenderer::restoreState()
+void LowLevelGraphicsSVGRenderer::popState()
 {
-    jassert(stateStack.size() > 0);
+    jassert(stateStack.size() > 1);
+
+    auto topLevelGroup = state->topLevelGroup;
+
     stateStack.removeLast();
     state = stateStack.getLast();
+
+    // The state's top level group is finished once no other state can draw
+    // into it
+    if (topLevelGroup)
+        noteFinished(topLevelGroup);
+
+    pruneCoverage();
+    spillFinishedContent();
 }
 
 #pragma mark -
@@ -208,37 +550,73 @@ void LowLevelGraphicsSVGRenderer::restoreState()
 
 void LowLevelGraphicsSVGRenderer::beginTransparencyLayer(float opacity)
 {
-    state->fillType.setOpacity(opacity);
+    JUCE_VECTOR_INSTRUMENT(beginTransparencyLayer)
+
+    if (auto hash = hashOp(Stats::beginTransparencyLayer))
+        hash->add(opacity);
+
+    pushState();
+
+    // The layer's group nests inside the current clip group, and any clips
+    // made inside the layer nest inside it in turn
+    openClipGroup();
+
+    state->layerGroup = state->clipGroup;
+    state->layerGroup->setAttribute(SVGIds::opacity, writeOpacity(opacity));
 }
 
 void LowLevelGraphicsSVGRenderer::endTransparencyLayer()
 {
-    state->fillType.setOpacity(1.0f);
+    JUCE_VECTOR_INSTRUMENT(endTransparencyLayer)
+
+    hashOp(Stats::endTransparencyLayer);
+
+    // Every state saved inside the layer must be restored before it ends
+    jassert(stateStack.size() > 1);
+    jassert(state->layerGroup != nullptr);
+    jassert(state->layerGroup != stateStack[stateStack.size() - 2]->layerGroup);
+
+    auto layer = state->layerGroup;
+
+    // Layers with nothing drawn in them are dropped, including those that
+    // only hold the groups of clips made inside them
+    if (!hasDrawnContent(*layer))
+    {
+        // The layer was opened inside the clip group of the state it was
+        // begun from
+        auto parent = stateStack[stateStack.size() - 2]->clipGroup;
+
+        if (!parent)
+            parent = document;
+
+        if (state->topLevelGroup == layer)
+            state->topLevelGroup = nullptr;
+
+        clearCoverage();
+        parent->removeChildElement(layer, true);
+    }
+
+    popState();
 }
 
 void LowLevelGraphicsSVGRenderer::setFill(const juce::FillType &fill)
 {
+    JUCE_VECTOR_INSTRUMENT(setFill)
+
+    if (auto hash = hashOp(Stats::setFill))
+        hash->add(fill);
+
     state->fillType = fill;
 
     if (fill.isGradient())
     {
-        auto defs = document->getChildElement(0);
-        jassert(defs);
-
         juce::String gradientType = (fill.gradient->isRadial)
             ? "radialGradient"
             : "linearGradient";
 
-        auto e = defs->createNewChildElement(gradientType);
-
-        state->gradientRef = juce::String::formatted(
-            "#Gradient%d",
-            defs->getNumChildElements()
-        );
-
-        e->setAttribute("id", state->gradientRef.replace("#", ""));
+        auto e = createDef(gradientType, "Gradient");
 
-        e->setAttribute("gradientUnits", "userSpaceOnUse");
+        e->setAttribute(SVGIds::gradientUnits, "userSpaceOnUse");
 
         auto point1 = fill.gradient->point1
             .translated(state->xOffset, state->yOffset);
@@ -246,25 +624,35 @@ void LowLevelGraphicsSVGRenderer::setFill(const juce::FillType &fill)
         auto point2 = fill.gradient->point2
             .translated(state->xOffset, state->yOffset);
 
+        // Translations and uniform scales keep the gradient's shape, so they
+        // can be applied to its points
+        auto bakeTransform = isUniformScale(state->transform);
+
+        if (bakeTransform)
+        {
+            point1 = point1.transformedBy(state->transform);
+            point2 = point2.transformedBy(state->transform);
+        }
+
         if (fill.gradient->isRadial)
         {
-            e->setAttribute("cx", truncateFloat(point1.x));
-            e->setAttribute("cy", truncateFloat(point1.y));
-            e->setAttribute("r",  truncateFloat(point1.getDistanceFrom(point2)));
-            e->setAttribute("fx", truncateFloat(point2.x));
-            e->setAttribute("fy", truncateFloat(point2.y));
+            e->setAttribute(SVGIds::cx, writeCoordinate(point1.x));
+            e->setAttribute(SVGIds::cy, writeCoordinate(point1.y));
+            e->setAttribute(SVGIds::r,  writeCoordinate(point1.getDistanceFrom(point2)));
+            e->setAttribute(SVGIds::fx, writeCoordinate(point2.x));
+            e->setAttribute(SVGIds::fy, writeCoordinate(point2.y));
         }
         else
         {
-            e->setAttribute("x1", truncateFloat(point1.x));
-            e->setAttribute("y1", truncateFloat(point1.y));
-            e->setAttribute("x2", truncateFloat(point2.x));
-            e->setAttribute("y2", truncateFloat(point2.y));
+            e->setAttribute(SVGIds::x1, writeCoordinate(point1.x));
+            e->setAttribute(SVGIds::y1, writeCoordinate(point1.y));
+            e->setAttribute(SVGIds::x2, writeCoordinate(point2.x));
+            e->setAttribute(SVGIds::y2, writeCoordinate(point2.y));
         }
 
-        if (!state->transform.isIdentity())
+        if (!bakeTransform)
             e->setAttribute(
-                "gradientTransform",
+                SVGIds::gradientTransform,
                 writeTransform(state->transform)
             );
 
@@ -272,7 +660,8 @@ void LowLevelGraphicsSVGRenderer::setFill(const juce::FillType &fill)
 
         if (prevRef.isNotEmpty())
         {
-            e->setAttribute("xlink:href", prevRef);
+            e->setAttribute(SVGIds::xlinkHref, prevRef);
+            noteDefReused();
         }
         else
         {
@@ -280,36 +669,63 @@ void LowLevelGraphicsSVGRenderer::setFill(const juce::FillType &fill)
             {
                 auto stop = e->createNewChildElement("stop");
                 stop->setAttribute(
-                    "offset",
+                    SVGIds::offset,
                     truncateFloat((float)fill.gradient->getColourPosition(i))
                 );
 
                 stop->setAttribute(
-                    "stop-color",
+                    SVGIds::stopColor,
                     writeColour(fill.gradient->getColour(i))
                 );
 
                 stop->setAttribute(
-                    "stop-opacity",
-                    truncateFloat(fill.gradient->getColour(i).getFloatAlpha())
+                    SVGIds::stopOpacity,
+                    writeOpacity(fill.gradient->getColour(i).getFloatAlpha())
                 );
             }
         }
+
+        state->gradientRef = finishDef(e);
+        state->fillURL     = "url(" + state->gradientRef + ")";
+
+        // Later gradients with the same stops link to this one
+        if (prevRef.isEmpty())
+        {
+            GradientRef newRef;
+            newRef.gradient = *fill.gradient;
+            newRef.ref = state->gradientRef;
+            newRef.scope = getDefScope();
+
+            previousGradients.add(newRef);
+        }
     }
     else
     {
         state->gradientRef = "";
+        state->fillURL     = fill.isTiledImage()
+            ? "url(" + getPatternRef(fill) + ")"
+            : juce::String();
     }
 }
 
 void LowLevelGraphicsSVGRenderer::setOpacity(float opacity)
 {
+    JUCE_VECTOR_INSTRUMENT(setOpacity)
+
+    if (auto hash = hashOp(Stats::setOpacity))
+        hash->add(opacity);
+
     state->fillType.setOpacity(opacity);
 }
 
 void LowLevelGraphicsSVGRenderer::setInterpolationQuality(
     juce::Graphics::ResamplingQuality quality)
 {
+    JUCE_VECTOR_INSTRUMENT(setInterpolationQuality)
+
+    if (auto hash = hashOp(Stats::setInterpolationQuality))
+        hash->add((int)quality);
+
     resampleQuality = quality;
 }
 
@@ -320,36 +736,75 @@ void LowLevelGraphicsSVGRenderer::fillRect(
     const juce::Rectangle<int> &r,
     bool replaceExistingContents)
 {
-    // TODO: Utilize replaceExistingContents
-    fillRect(r.toFloat());
+    JUCE_VECTOR_INSTRUMENT(fillRect)
+
+    if (isCulled())
+        return;
+
+    if (auto hash = hashOp(Stats::fillRect))
+    {
+        hash->add(r);
+        hash->add(replaceExistingContents);
+    }
+
+    // Everything under the rectangle is replaced, whatever its fill
+    if (replaceExistingContents)
+        removeCoveredElements(
+            r.translated(state->xOffset, state->yOffset).toFloat()
+        );
+
+    fillRectInternal(r.toFloat());
 }
 
 void LowLevelGraphicsSVGRenderer::fillRect(const juce::Rectangle<float> &r)
 {
-    juce::XmlElement *rect;
+    JUCE_VECTOR_INSTRUMENT(fillRect)
 
-    if (state->clipGroup)
-        rect = state->clipGroup->createNewChildElement("rect");
-    else
-        rect = document->createNewChildElement("rect");
+    if (isCulled())
+        return;
 
-    rect->setAttribute("fill", writeFill());
-    rect->setAttribute(
-        "fill-opacity",
-        truncateFloat(state->fillType.getOpacity())
-    );
+    if (auto hash = hashOp(Stats::fillRect))
+        hash->add(r);
+
+    fillRectInternal(r);
+}
+
+void LowLevelGraphicsSVGRenderer::fillRectInternal(
+    const juce::Rectangle<float> &r)
+{
+    auto bounds = r.translated((float)state->xOffset, (float)state->yOffset);
+
+    if (isOpaque(state->fillType))
+        removeCoveredElements(bounds);
+
+    auto rect = createElement("rect");
+
+    rect->setAttribute(SVGIds::fill, writeFill());
+    applyOpacity(rect, SVGIds::fillOpacity, state->fillType.getOpacity());
 
-    rect->setAttribute("x", truncateFloat(r.getX() + state->xOffset));
-    rect->setAttribute("y", truncateFloat(r.getY() + state->yOffset));
-    rect->setAttribute("width",  truncateFloat(r.getWidth()));
-    rect->setAttribute("height", truncateFloat(r.getHeight()));
+    rect->setAttribute(SVGIds::x, writeCoordinate(r.getX() + state->xOffset));
+    rect->setAttribute(SVGIds::y, writeCoordinate(r.getY() + state->yOffset));
+    rect->setAttribute(SVGIds::width,  writeCoordinate(r.getWidth()));
+    rect->setAttribute(SVGIds::height, writeCoordinate(r.getHeight()));
 
     applyTags(rect);
+    noteElementBounds(rect, bounds);
 }
 
 void LowLevelGraphicsSVGRenderer::fillRectList(
     const juce::RectangleList<float> &r)
 {
+    JUCE_VECTOR_INSTRUMENT(fillRectList)
+
+    if (isCulled())
+        return;
+
+    if (auto hash = hashOp(Stats::fillRectList))
+    {
+        for (auto &rect : r)
+            hash->add(rect);
+    }
+
     fillPath(r.toPath(), juce::AffineTransform());
 }
 
@@ -357,101 +812,199 @@ void LowLevelGraphicsSVGRenderer::fillPath(
     const juce::Path &p,
     const juce::AffineTransform &t)
 {
-    juce::XmlElement *path;
+    JUCE_VECTOR_INSTRUMENT(fillPath)
 
-    if (state->clipGroup)
-        path = state->clipGroup->createNewChildElement("path");
-    else
-        path = document->createNewChildElement("path");
+    if (isCulled())
+        return;
 
-    auto temp = p;
-    temp.applyTransform(t.translated(state->xOffset, state->yOffset));
+    if (auto hash = hashOp(Stats::fillPath))
+    {
+        hash->add(p);
+        hash->add(t);
+        hash->add(pathTolerance);
+    }
 
-    juce::String d = temp.toString().removeCharacters("a");
-    path->setAttribute("d", d.toUpperCase());
+    auto path = createElement("path");
+    auto pathTransform = t.translated(state->xOffset, state->yOffset);
+    juce::Rectangle<float> bounds;
 
-    path->setAttribute("fill", writeFill());
-    path->setAttribute(
-        "fill-opacity",
-        truncateFloat(state->fillType.getOpacity())
-    );
+    // The tolerance is in output pixels, so it shrinks as the context's
+    // transform scales paths up
+    auto scale = state->transform.getScaleFactor();
+
+    if (pathTolerance > 0.0f && scale > 0.0f)
+    {
+        auto temp = p;
+        temp.applyTransform(pathTransform);
+
+        path->setAttribute(
+            SVGIds::d,
+            writePath(
+                SVGKernels::simplifyPath(temp, pathTolerance / scale),
+                juce::AffineTransform(),
+                &bounds
+            )
+        );
+    }
+    else
+    {
+        path->setAttribute(SVGIds::d, writePath(p, pathTransform, &bounds));
+    }
+
+    path->setAttribute(SVGIds::fill, writeFill());
+    applyOpacity(path, SVGIds::fillOpacity, state->fillType.getOpacity());
 
     if (!p.isUsingNonZeroWinding())
-        path->setAttribute("fill-rule", "evenodd");
+        path->setAttribute(SVGIds::fillRule, "evenodd");
 
     applyTags(path);
+    noteElementBounds(path, bounds);
 }
 
 void LowLevelGraphicsSVGRenderer::drawImage(
     const juce::Image &i,
     const juce::AffineTransform &t)
 {
-    juce::XmlElement *image;
+    JUCE_VECTOR_INSTRUMENT(drawImage)
 
-    if (state->clipGroup)
-        image = state->clipGroup->createNewChildElement("image");
-    else
-        image = document->createNewChildElement("image");
+    if (isCulled())
+        return;
 
-    image->setAttribute("x", state->xOffset);
-    image->setAttribute("y", state->yOffset);
-    image->setAttribute("width", i.getWidth());
-    image->setAttribute("height", i.getHeight());
+    auto imageHash = hashImage(i);
 
-    image->setAttribute("image-rendering", writeImageQuality());
+    if (auto hash = hashOp(Stats::drawImage))
+    {
+        hash->add(imageHash);
+        hash->add(t);
+    }
 
-    if (!t.isIdentity())
-        image->setAttribute(
-            "transform",
-            writeTransform(state->transform.followedBy(t))
-        );
+    auto image = createElement("use");
 
-    juce::MemoryOutputStream out;
-    juce::PNGImageFormat png;
-    png.writeImageToStream(i, out);
+    // The image's own transform is applied first, then the origin and the
+    // context's transform, as for everything else that's drawn
+    auto transform = t
+        .translated((float)state->xOffset, (float)state->yOffset)
+        .followedBy(state->transform);
 
-    auto base64Data = juce::Base64::toBase64(out.getData(), out.getDataSize());
-    image->setAttribute("xlink:href", "data:image/png;base64," + base64Data);
+    auto bounds = juce::Rectangle<float>((float)i.getWidth(), (float)i.getHeight())
+        .transformedBy(transform);
 
-    applyTags(image);
-}
+    // A translation is written as the position, and under a scale it's the
+    // position in scaled coordinates, so only the scale factors are written
+    switch (classifyTransform(transform))
+    {
+        case TransformType::identity:
+            break;
 
-void LowLevelGraphicsSVGRenderer::drawLine(const juce::Line<float> &l)
-{
-    juce::XmlElement *line;
+        case TransformType::translation:
+            image->setAttribute(SVGIds::x, writeCoordinate(transform.mat02));
+            image->setAttribute(SVGIds::y, writeCoordinate(transform.mat12));
+            break;
 
-    if (state->clipGroup)
-        line = state->clipGroup->createNewChildElement("line");
-    else
-        line = document->createNewChildElement("line");
+        case TransformType::scale:
+            if (transform.mat00 != 0.0f && transform.mat11 != 0.0f)
+            {
+                auto scale = juce::AffineTransform::scale(transform.mat00, transform.mat11);
 
-    line->setAttribute("x1", truncateFloat(l.getStartX() + state->xOffset));
-    line->setAttribute("y1", truncateFloat(l.getStartY() + state->yOffset));
-    line->setAttribute("x2", truncateFloat(l.getEndX()   + state->xOffset));
-    line->setAttribute("y2", truncateFloat(l.getEndY()   + state->yOffset));
+                image->setAttribute(SVGIds::x, writeCoordinate(transform.mat02 / transform.mat00));
+                image->setAttribute(SVGIds::y, writeCoordinate(transform.mat12 / transform.mat11));
+                image->setAttribute(SVGIds::transform, writeTransform(scale));
+                break;
+            }
 
-    line->setAttribute("stroke", writeFill());
-    line->setAttribute(
-        "stroke-opacity",
-        truncateFloat(state->fillType.getOpacity())
-    );
+            image->setAttribute(SVGIds::transform, writeTransform(transform));
+            break;
 
-    if (!state->transform.isIdentity())
-        line->setAttribute("transform", writeTransform(state->transform));
+        case TransformType::general:
+            image->setAttribute(SVGIds::transform, writeTransform(transform));
+            break;
+    }
 
-    applyTags(line);
-}
+    image->setAttribute(SVGIds::imageRendering, writeImageQuality());
 
-#pragma mark -
-// =============================================================================
+    image->setAttribute(
+        SVGIds::xlinkHref,
+        getImageRef(i, imageHash, transform)
+    );
+
+    applyTags(image);
+    noteElementBounds(image, bounds);
+}
+
+void LowLevelGraphicsSVGRenderer::drawLine(const juce::Line<float> &l)
+{
+    JUCE_VECTOR_INSTRUMENT(drawLine)
+
+    if (isCulled())
+        return;
+
+    if (auto hash = hashOp(Stats::drawLine))
+    {
+        hash->add(l.getStartX());
+        hash->add(l.getStartY());
+        hash->add(l.getEndX());
+        hash->add(l.getEndY());
+    }
+
+    auto line = createElement("line");
+
+    auto start = l.getStart() + juce::Point<float>((float)state->xOffset, (float)state->yOffset);
+    auto end   = l.getEnd()   + juce::Point<float>((float)state->xOffset, (float)state->yOffset);
+
+    // Lines are stroked one unit wide, so their bounds are padded to cover
+    // the stroke. Under a translation or uniform scale the end points are
+    // moved instead, and the stroke is scaled to match.
+    auto strokeWidth = 1.0f;
+    auto bakeTransform = isUniformScale(state->transform);
+
+    if (bakeTransform)
+    {
+        start = start.transformedBy(state->transform);
+        end   = end.transformedBy(state->transform);
+
+        strokeWidth = std::abs(state->transform.mat00);
+    }
+
+    line->setAttribute(SVGIds::x1, writeCoordinate(start.x));
+    line->setAttribute(SVGIds::y1, writeCoordinate(start.y));
+    line->setAttribute(SVGIds::x2, writeCoordinate(end.x));
+    line->setAttribute(SVGIds::y2, writeCoordinate(end.y));
+
+    line->setAttribute(SVGIds::stroke, writeFill());
+    applyOpacity(line, SVGIds::strokeOpacity, state->fillType.getOpacity());
+
+    if (strokeWidth != 1.0f)
+        line->setAttribute(SVGIds::strokeWidth, writeCoordinate(strokeWidth));
+
+    auto bounds = juce::Rectangle<float>(start, end).expanded(strokeWidth);
+
+    if (!bakeTransform)
+    {
+        line->setAttribute(SVGIds::transform, writeTransform(state->transform));
+        bounds = bounds.transformedBy(state->transform);
+    }
+
+    applyTags(line);
+    noteElementBounds(line, bounds);
+}
+
+#pragma mark -
+// =============================================================================
 
 void LowLevelGraphicsSVGRenderer::setFont(const juce::Font &f)
 {
+    JUCE_VECTOR_INSTRUMENT(setFont)
+
+    if (auto hash = hashOp(Stats::setFont))
+        hash->add(f);
+
     state->font = f;
 }
 
 const juce::Font& LowLevelGraphicsSVGRenderer::getFont()
 {
+    JUCE_VECTOR_INSTRUMENT(getFont)
+
     return state->font;
 }
 
@@ -459,6 +1012,17 @@ void LowLevelGraphicsSVGRenderer::drawGlyph(
     int glyphNumber,
     const juce::AffineTransform &t)
 {
+    JUCE_VECTOR_INSTRUMENT(drawGlyph)
+
+    if (isCulled())
+        return;
+
+    if (auto hash = hashOp(Stats::drawGlyph))
+    {
+        hash->add(glyphNumber);
+        hash->add(t);
+    }
+
     juce::Path p;
     juce::Font &f = state->font;
     f.getTypeface()->getOutlineForGlyph(glyphNumber, p);
@@ -482,38 +1046,43 @@ void LowLevelGraphicsSVGRenderer::drawSingleLineText(
     int baselineY,
     juce::Justification justification)
 {
-    juce::XmlElement *text;
+    JUCE_VECTOR_INSTRUMENT(drawSingleLineText)
 
-    if (state->clipGroup)
-        text = state->clipGroup->createNewChildElement("text");
-    else
-        text = document->createNewChildElement("text");
+    if (isCulled())
+        return;
+
+    if (auto hash = hashOp(Stats::drawSingleLineText))
+    {
+        hash->add(t);
+        hash->add(startX);
+        hash->add(baselineY);
+        hash->add(justification.getFlags());
+    }
+
+    auto text = createElement("text");
 
     auto f = state->font;
     auto tf = f.getTypeface();
 
-    text->setAttribute("x", startX);
-    text->setAttribute("y", baselineY - f.getHeight());
-    text->setAttribute("font-family", tf->getName());
-    text->setAttribute("font-style", tf->getStyle());
-    text->setAttribute("font-size", f.getHeight());
-    text->setAttribute("fill", writeFill());
+    auto bake = applyTextTransform(text);
+
+    writeTextPosition(text, (float)startX, baselineY - f.getHeight(), bake);
+    text->setAttribute(SVGIds::fontFamily, tf->getName());
+    text->setAttribute(SVGIds::fontStyle, tf->getStyle());
+    text->setAttribute(SVGIds::fontSize, writeCoordinate(f.getHeight() * bake.mat00));
+    text->setAttribute(SVGIds::fill, writeFill());
 
     if (justification.testFlags(justification.left))
-        text->setAttribute("text-anchor", "start");
+        text->setAttribute(SVGIds::textAnchor, "start");
 
     else if (justification.testFlags(justification.horizontallyCentred))
-        text->setAttribute("text-anchor", "middle");
+        text->setAttribute(SVGIds::textAnchor, "middle");
 
     else if (justification.testFlags(justification.right))
-        text->setAttribute("text-anchor", "end");
+        text->setAttribute(SVGIds::textAnchor, "end");
 
     else
-        text->setAttribute("text-anchor", "inherited");
-
-
-    if (!state->transform.isIdentity())
-        text->setAttribute("transform", writeTransform(state->transform));
+        text->setAttribute(SVGIds::textAnchor, "inherited");
 
     text->addTextElement(t);
 
@@ -526,25 +1095,31 @@ void LowLevelGraphicsSVGRenderer::drawMultiLineText(
     int baselineY,
     int maximumLineWidth)
 {
-    juce::XmlElement *text;
+    JUCE_VECTOR_INSTRUMENT(drawMultiLineText)
 
-    if (state->clipGroup)
-        text = state->clipGroup->createNewChildElement("text");
-    else
-        text = document->createNewChildElement("text");
+    if (isCulled())
+        return;
+
+    if (auto hash = hashOp(Stats::drawMultiLineText))
+    {
+        hash->add(t);
+        hash->add(startX);
+        hash->add(baselineY);
+        hash->add(maximumLineWidth);
+    }
+
+    auto text = createElement("text");
 
     auto f = state->font;
     auto tf = f.getTypeface();
 
-    text->setAttribute("x", startX);
-    text->setAttribute("y", baselineY - f.getHeight());
-    text->setAttribute("font-family", tf->getName());
-    text->setAttribute("font-style", tf->getStyle());
-    text->setAttribute("font-size", f.getHeight());
-    text->setAttribute("fill", writeFill());
+    auto bake = applyTextTransform(text);
 
-    if (!state->transform.isIdentity())
-        text->setAttribute("transform", writeTransform(state->transform));
+    writeTextPosition(text, (float)startX, baselineY - f.getHeight(), bake);
+    text->setAttribute(SVGIds::fontFamily, tf->getName());
+    text->setAttribute(SVGIds::fontStyle, tf->getStyle());
+    text->setAttribute(SVGIds::fontSize, writeCoordinate(f.getHeight() * bake.mat00));
+    text->setAttribute(SVGIds::fill, writeFill());
 
     auto t2 = t;
 
@@ -564,8 +1139,7 @@ void LowLevelGraphicsSVGRenderer::drawMultiLineText(
             }
 
             auto tspan = text->createNewChildElement("tspan");
-            tspan->setAttribute("x", startX);
-            tspan->setAttribute("y", baselineY);
+            writeTextPosition(tspan, (float)startX, (float)baselineY, bake);
             tspan->addTextElement(line);
 
             t2 = t2.substring(i);
@@ -575,8 +1149,7 @@ void LowLevelGraphicsSVGRenderer::drawMultiLineText(
         else
         {
             auto tspan = text->createNewChildElement("tspan");
-            tspan->setAttribute("x", startX);
-            tspan->setAttribute("y", baselineY);
+            writeTextPosition(tspan, (float)startX, (float)baselineY, bake);
             tspan->addTextElement(t2);
 
             t2 = "";
@@ -595,25 +1168,91 @@ void LowLevelGraphicsSVGRenderer::drawText(
     juce::Justification justification,
     bool useEllipsesIfTooBig)
 {
-    juce::XmlElement *text;
+    JUCE_VECTOR_INSTRUMENT(drawText)
 
-    if (state->clipGroup)
-        text = state->clipGroup->createNewChildElement("text");
-    else
-        text = document->createNewChildElement("text");
+    if (isCulled())
+        return;
+
+    drawTextInternal(t, x, y, width, height, justification, useEllipsesIfTooBig);
+}
+
+void LowLevelGraphicsSVGRenderer::drawText(
+    const juce::String &t,
+    juce::Rectangle<int> area,
+    juce::Justification justification,
+    bool useEllipsesIfTooBig)
+{
+    JUCE_VECTOR_INSTRUMENT(drawText)
+
+    if (isCulled())
+        return;
+
+    drawTextInternal(
+        t,
+        area.getX(),
+        area.getY(),
+        area.getWidth(),
+        area.getHeight(),
+        justification,
+        useEllipsesIfTooBig
+    );
+}
+
+void LowLevelGraphicsSVGRenderer::drawText(
+    const juce::String &t,
+    juce::Rectangle<float> area,
+    juce::Justification justification,
+    bool useEllipsesIfTooBig)
+{
+    JUCE_VECTOR_INSTRUMENT(drawText)
+
+    if (isCulled())
+        return;
+
+    drawTextInternal(
+        t,
+        (int)area.getX(),
+        (int)area.getY(),
+        (int)area.getWidth(),
+        (int)area.getHeight(),
+        justification,
+        useEllipsesIfTooBig
+    );
+}
+
+void LowLevelGraphicsSVGRenderer::drawTextInternal(
+    const juce::String &t,
+    int x,
+    int y,
+    int width,
+    int height,
+    juce::Justification justification,
+    bool useEllipsesIfTooBig)
+{
+    // Every overload is hashed the same way, so they share cached output
+    if (auto hash = hashOp(Stats::drawText))
+    {
+        hash->add(t);
+        hash->add(x);
+        hash->add(y);
+        hash->add(width);
+        hash->add(height);
+        hash->add(justification.getFlags());
+        hash->add(useEllipsesIfTooBig);
+    }
+
+    auto text = createElement("text");
 
     auto f = state->font;
     auto tf = f.getTypeface();
 
-    applyTextPos(text, x, y, width, height, justification);
+    auto bake = applyTextTransform(text);
+    applyTextPos(text, x, y, width, height, justification, bake);
 
-    text->setAttribute("font-family", tf->getName());
-    text->setAttribute("font-style", tf->getStyle());
-    text->setAttribute("font-size", f.getHeight());
-    text->setAttribute("fill", writeFill());
-
-    if (!state->transform.isIdentity())
-        text->setAttribute("transform", writeTransform(state->transform));
+    text->setAttribute(SVGIds::fontFamily, tf->getName());
+    text->setAttribute(SVGIds::fontStyle, tf->getStyle());
+    text->setAttribute(SVGIds::fontSize, writeCoordinate(f.getHeight() * bake.mat00));
+    text->setAttribute(SVGIds::fill, writeFill());
 
     auto t2 = t;
 
@@ -637,41 +1276,58 @@ void LowLevelGraphicsSVGRenderer::drawText(
     applyTags(text);
 }
 
-void LowLevelGraphicsSVGRenderer::drawText(
+void LowLevelGraphicsSVGRenderer::drawFittedText(
     const juce::String &t,
-    juce::Rectangle<int> area,
+    int x,
+    int y,
+    int width,
+    int height,
     juce::Justification justification,
-    bool useEllipsesIfTooBig)
+    int maximumNumberOfLines,
+    float minimumHorizontalScale)
 {
-    drawText(
+    JUCE_VECTOR_INSTRUMENT(drawFittedText)
+
+    if (isCulled())
+        return;
+
+    drawFittedTextInternal(
         t,
-        area.getX(),
-        area.getY(),
-        area.getWidth(),
-        area.getHeight(),
+        x,
+        y,
+        width,
+        height,
         justification,
-        useEllipsesIfTooBig
+        maximumNumberOfLines,
+        minimumHorizontalScale
     );
 }
 
-void LowLevelGraphicsSVGRenderer::drawText(
+void LowLevelGraphicsSVGRenderer::drawFittedText(
     const juce::String &t,
-    juce::Rectangle<float> area,
+    juce::Rectangle<int> area,
     juce::Justification justification,
-    bool useEllipsesIfTooBig)
+    int maximumNumberOfLines,
+    float minimumHorizontalScale)
 {
-    drawText(
+    JUCE_VECTOR_INSTRUMENT(drawFittedText)
+
+    if (isCulled())
+        return;
+
+    drawFittedTextInternal(
         t,
-        (int)area.getX(),
-        (int)area.getY(),
-        (int)area.getWidth(),
-        (int)area.getHeight(),
+        area.getX(),
+        area.getY(),
+        area.getWidth(),
+        area.getHeight(),
         justification,
-        useEllipsesIfTooBig
+        maximumNumberOfLines,
+        minimumHorizontalScale
     );
 }
 
-void LowLevelGraphicsSVGRenderer::drawFittedText(
+void LowLevelGraphicsSVGRenderer::drawFittedTextInternal(
     const juce::String &t,
     int x,
     int y,
@@ -681,29 +1337,37 @@ void LowLevelGraphicsSVGRenderer::drawFittedText(
     int maximumNumberOfLines,
     float minimumHorizontalScale)
 {
-    juce::XmlElement *text;
+    if (auto hash = hashOp(Stats::drawFittedText))
+    {
+        hash->add(t);
+        hash->add(x);
+        hash->add(y);
+        hash->add(width);
+        hash->add(height);
+        hash->add(justification.getFlags());
+        hash->add(maximumNumberOfLines);
+        hash->add(minimumHorizontalScale);
+    }
 
-    if (state->clipGroup)
-        text = state->clipGroup->createNewChildElement("text");
-    else
-        text = document->createNewChildElement("text");
+    auto text = createElement("text");
 
     auto f = state->font;
     auto tf = f.getTypeface();
 
-    applyTextPos(text, x, y, width, height, justification);
+    auto bake = applyTextTransform(text);
+    applyTextPos(text, x, y, width, height, justification, bake);
 
     // TODO: support minimumHorizontalScale values
     if (minimumHorizontalScale == 0.0f)
     {
-        text->setAttribute("textLength", width);
-        text->setAttribute("lengthAdjust", "spacingAndGlyphs");
+        text->setAttribute(SVGIds::textLength, writeCoordinate(width * bake.mat00));
+        text->setAttribute(SVGIds::lengthAdjust, "spacingAndGlyphs");
     }
 
-    text->setAttribute("font-family", tf->getName());
-    text->setAttribute("font-style", tf->getStyle());
-    text->setAttribute("font-size", f.getHeight());
-    text->setAttribute("fill", writeFill());
+    text->setAttribute(SVGIds::fontFamily, tf->getName());
+    text->setAttribute(SVGIds::fontStyle, tf->getStyle());
+    text->setAttribute(SVGIds::fontSize, writeCoordinate(f.getHeight() * bake.mat00));
+    text->setAttribute(SVGIds::fill, writeFill());
 
     auto t2 = t;
 
@@ -725,10 +1389,9 @@ void LowLevelGraphicsSVGRenderer::drawFittedText(
                 }
 
                 auto tspan = text->createNewChildElement("tspan");
-                tspan->setAttribute("x", x);
-                tspan->setAttribute("y", y);
-                tspan->setAttribute("text-anchor", "auto");
-                tspan->setAttribute("dominant-baseline", "auto");
+                writeTextPosition(tspan, (float)x, (float)y, bake);
+                tspan->setAttribute(SVGIds::textAnchor, "auto");
+                tspan->setAttribute(SVGIds::dominantBaseline, "auto");
                 tspan->addTextElement(line);
 
                 t2 = t2.substring(i);
@@ -738,10 +1401,9 @@ void LowLevelGraphicsSVGRenderer::drawFittedText(
             else
             {
                 auto tspan = text->createNewChildElement("tspan");
-                tspan->setAttribute("x", x);
-                tspan->setAttribute("y", y);
-                tspan->setAttribute("text-anchor", "auto");
-                tspan->setAttribute("dominant-baseline", "auto");
+                writeTextPosition(tspan, (float)x, (float)y, bake);
+                tspan->setAttribute(SVGIds::textAnchor, "auto");
+                tspan->setAttribute(SVGIds::dominantBaseline, "auto");
                 tspan->addTextElement(t2);
 
                 t2 = "";
@@ -764,175 +1426,2225 @@ void LowLevelGraphicsSVGRenderer::drawFittedText(
     applyTags(text);
 }
 
-void LowLevelGraphicsSVGRenderer::drawFittedText(
-    const juce::String &t,
-    juce::Rectangle<int> area,
-    juce::Justification justification,
-    int maximumNumberOfLines,
-    float minimumHorizontalScale)
-{
-    drawFittedText(
-        t,
-        area.getX(),
-        area.getY(),
-        area.getWidth(),
-        area.getHeight(),
-        justification,
-        maximumNumberOfLines,
-        minimumHorizontalScale
-    );
-}
-
 #pragma mark -
 // =============================================================================
 
 void LowLevelGraphicsSVGRenderer::pushGroup(const juce::String& groupID)
 {
-    if (!state->clipGroup)
-        state->clipGroup = document->createNewChildElement("g");
-    else
-        state->clipGroup = state->clipGroup->createNewChildElement("g");
+    JUCE_VECTOR_INSTRUMENT(pushGroup)
+
+    if (auto hash = hashOp(Stats::pushGroup))
+        hash->add(groupID);
+
+    openClipGroup();
+
+    state->clipGroup->setAttribute(SVGIds::id, groupID);
+
+    OpenGroup group;
+    group.element = state->clipGroup;
+    group.key = (openGroups.isEmpty() ? juce::String() : openGroups.getLast().key)
+        + "/" + groupID;
+
+    // Groups with the same ID under the same parent are told apart by the
+    // order they're drawn in
+    auto occurrence = groupKeyCounts[group.key];
+    groupKeyCounts.set(group.key, occurrence + 1);
 
-    state->clipGroup->setAttribute("id", groupID);
+    if (occurrence > 0)
+        group.key << "#" << occurrence;
+
+    if (resultCache)
+        group.hash.next = &documentHash;
+
+    if (snapshotCache)
+        hashState(group.hash);
+
+    openGroups.add(group);
+
+    // Gradients and patterns set before the group belong to the enclosing
+    // scope, so the current one is recreated inside the group to keep it
+    // self-contained
+    if (snapshotCache && (state->fillType.isGradient() || state->fillType.isTiledImage()))
+    {
+        auto fill = state->fillType;
+        setFill(fill);
+    }
 }
 
 void LowLevelGraphicsSVGRenderer::popGroup()
 {
+    JUCE_VECTOR_INSTRUMENT(popGroup)
+
     jassert(state->clipGroup);
 
-    if (state->clipGroup->hasAttribute("id"))
+    // Popping a group can delete elements (when it's empty or reused from a
+    // snapshot), so nothing can stay tracked across it
+    clearCoverage();
+
+    if (state->clipGroup->hasAttribute(SVGIds::id))
     {
         auto temp = state->clipGroup;
 
-        state->clipGroup = document->findParentElementOf(state->clipGroup);
+        state->clipGroup = state->clipGroup->getParentElement();
+
+        if (state->clipGroup == document)
+            state->topLevelGroup = nullptr;
 
         if (temp->getNumChildElements() == 0)
             state->clipGroup->removeChildElement(temp, true);
+        else if (snapshotCache && !openGroups.isEmpty()
+                 && openGroups.getLast().element == temp)
+            finishSnapshotGroup(openGroups.getLast());
+        else if (state->clipGroup == document)
+            noteFinished(temp);
     }
     else
     {
         jassertfalse;  // More popGroup() calls than pushGroup()!
     }
+
+    if (!openGroups.isEmpty())
+    {
+        auto groupHash = openGroups.getLast().hash.value;
+        openGroups.removeLast();
+
+        if (auto hash = hashOp(Stats::popGroup))
+            hash->add(groupHash);
+    }
+
+    spillFinishedContent();
 }
 
 void LowLevelGraphicsSVGRenderer::setTags(const juce::StringPairArray &s)
 {
+    JUCE_VECTOR_INSTRUMENT(setTags)
+
+    if (auto hash = hashOp(Stats::setTags))
+        hash->add(s);
+
     state->tags = s;
 }
 
 void LowLevelGraphicsSVGRenderer::clearTags()
 {
+    JUCE_VECTOR_INSTRUMENT(clearTags)
+
+    hashOp(Stats::clearTags);
+
     state->tags.clear();
 }
 
 #pragma mark -
 // =============================================================================
 
-juce::String LowLevelGraphicsSVGRenderer::truncateFloat(float value)
+void LowLevelGraphicsSVGRenderer::setImageDownsampling(
+    bool shouldDownsample,
+    float oversampling)
 {
-    auto string = juce::String(value, 2);
+    jassert(oversampling > 0.0f);
 
-    while (string.getLastCharacters(1) == "." ||
-          (string.getLastCharacters(1) == "0" && string.contains(".")))
-            string = string.dropLastCharacters(1);
-
-    return string;
+    downsampleImages  = shouldDownsample;
+    imageOversampling = oversampling;
 }
 
-juce::String LowLevelGraphicsSVGRenderer::getPreviousGradientRef(
-    juce::ColourGradient *g)
+void LowLevelGraphicsSVGRenderer::setEncodedImageCache(EncodedImageCache *cache)
 {
-    if (previousGradients.size() == 0)
-    {
-        jassert(state->gradientRef.isNotEmpty());
-
-        GradientRef newRef;
-        newRef.gradient = *g;
-        newRef.ref = state->gradientRef;
-
-        previousGradients.add(newRef);
-        return "";
-    }
+    encodedImageCache = cache;
+}
 
-    for (auto r : previousGradients)
-    {
-        auto previousGradient = &r.gradient;
+void LowLevelGraphicsSVGRenderer::setImageCodecPolicy(ImageCodecPolicy *policy)
+{
+    if (policy)
+        codecPolicy.reset(policy);
+    else
+        codecPolicy.reset(new DefaultImageCodecPolicy());
 
-        if (previousGradient->getNumColours() != g->getNumColours())
-            continue;
+    // Images embedded so far were encoded by the previous policy
+    imageRefs.clear();
+}
 
-        bool match = false;
+void LowLevelGraphicsSVGRenderer::setPathSimplification(float toleranceInPixels)
+{
+    jassert(toleranceInPixels >= 0.0f);
 
-        for (int i = 0; i < previousGradient->getNumColours(); ++i)
-        {
-            auto colour = previousGradient->getColour(i);
-            auto pos    = previousGradient->getColourPosition(i);
+    pathTolerance = toleranceInPixels;
+}
 
-            if (g->getColour(i) != colour)
-                break;
+#pragma mark -
+// =============================================================================
 
-            if (g->getColourPosition(i) != pos)
-                break;
+LowLevelGraphicsSVGRenderer::PrecisionPolicy
+LowLevelGraphicsSVGRenderer::PrecisionPolicy::decimalPlaces(int places)
+{
+    jassert(places >= 0 && places <= maxDecimalPlaces);
 
-            match = true;
-        }
+    PrecisionPolicy p;
+    p.mode   = Mode::decimalPlaces;
+    p.digits = places;
 
-        if (match)
-            return r.ref;
-    }
+    return p;
+}
 
-    jassert(state->gradientRef.isNotEmpty());
+LowLevelGraphicsSVGRenderer::PrecisionPolicy
+LowLevelGraphicsSVGRenderer::PrecisionPolicy::significantDigits(int numDigits)
+{
+    jassert(numDigits > 0);
 
-    GradientRef newRef;
-    newRef.gradient = *g;
-    newRef.ref = state->gradientRef;
+    PrecisionPolicy p;
+    p.mode   = Mode::significantDigits;
+    p.digits = numDigits;
 
-    previousGradients.add(newRef);
-    return "";
+    return p;
 }
 
-juce::String LowLevelGraphicsSVGRenderer::writeTransform(
-    const juce::AffineTransform &t)
+LowLevelGraphicsSVGRenderer::PrecisionPolicy
+LowLevelGraphicsSVGRenderer::PrecisionPolicy::automatic(float maxErrorInPixels)
 {
-    return juce::String::formatted(
-        "matrix(%f,%f,%f,%f,%f,%f)",
-        t.mat00, t.mat01, t.mat02,
-        t.mat10, t.mat11, t.mat12
-    );
-}
+    jassert(maxErrorInPixels > 0.0f);
 
-juce::String LowLevelGraphicsSVGRenderer::writeColour(const juce::Colour &c)
-{
-    return juce::String::formatted(
-        "rgb(%d,%d,%d)",
-        c.getRed(), c.getGreen(), c.getBlue()
-    );
-}
+    PrecisionPolicy p;
+    p.mode     = Mode::automatic;
+    p.maxError = maxErrorInPixels;
 
-juce::String LowLevelGraphicsSVGRenderer::writeFill()
-{
-    if (state->fillType.isGradient())
-        return "url(" + state->gradientRef + ")";
-    else
-        return writeColour(state->fillType.colour);
+    return p;
 }
 
-juce::String LowLevelGraphicsSVGRenderer::writeImageQuality()
+int LowLevelGraphicsSVGRenderer::PrecisionPolicy::getDecimalPlaces(
+    float value,
+    float canvasSize,
+    float scale) const
 {
-    switch (resampleQuality)
+    switch (mode)
     {
-        case juce::Graphics::lowResamplingQuality:
+        case Mode::decimalPlaces:
+            return juce::jlimit(0, maxDecimalPlaces, digits);
+
+        case Mode::significantDigits:
+        {
+            if (value == 0.0f || !std::isfinite(value))
+                return 0;
+
+            auto integerDigits = (int)std::floor(std::log10(std::abs(value))) + 1;
+            return juce::jlimit(0, maxDecimalPlaces, digits - integerDigits);
+        }
+
+        case Mode::automatic:
+        {
+            // Rounding to n places is off by at most half of 10^-n, which the
+            // scale then magnifies. A float only has about 7 significant
+            // digits, so places beyond those left by the canvas size are noise.
+            auto needed = (int)std::ceil(
+                std::log10(juce::jmax(scale, 1.0e-6f) / (2.0f * maxError))
+            );
+
+            auto canvasDigits = (int)std::floor(std::log10(juce::jmax(canvasSize, 1.0f))) + 1;
+
+            return juce::jlimit(0, maxDecimalPlaces, juce::jmin(needed, 7 - canvasDigits));
+        }
+    }
+
+    return digits;
+}
+
+void LowLevelGraphicsSVGRenderer::setPrecisionPolicy(const PrecisionPolicy &p)
+{
+    precision = p;
+}
+
+const LowLevelGraphicsSVGRenderer::PrecisionPolicy&
+LowLevelGraphicsSVGRenderer::getPrecisionPolicy() const
+{
+    return precision;
+}
+
+#pragma mark -
+// =============================================================================
+
+double LowLevelGraphicsSVGRenderer::Stats::Counter::getSeconds() const
+{
+    return juce::Time::highResolutionTicksToSeconds(ticks);
+}
+
+juce::String LowLevelGraphicsSVGRenderer::Stats::getOperationName(
+    Operation operation)
+{
+    static const char* const names[] =
+    {
+        "setOrigin",
+        "addTransform",
+        "clipToRectangle",
+        "clipToRectangleList",
+        "excludeClipRectangle",
+        "clipToPath",
+        "clipToImageAlpha",
+        "clipRegionIntersects",
+        "getClipBounds",
+        "isClipEmpty",
+        "setClip",
+        "saveState",
+        "restoreState",
+        "beginTransparencyLayer",
+        "endTransparencyLayer",
+        "setFill",
+        "setOpacity",
+        "setInterpolationQuality",
+        "fillRect",
+        "fillRectList",
+        "fillPath",
+        "drawImage",
+        "drawLine",
+        "setFont",
+        "getFont",
+        "drawGlyph",
+        "drawSingleLineText",
+        "drawMultiLineText",
+        "drawText",
+        "drawFittedText",
+        "pushGroup",
+        "popGroup",
+        "setTags",
+        "clearTags"
+    };
+
+    static_assert(
+        sizeof(names) / sizeof(names[0]) == numOperations,
+        "Every operation needs a name"
+    );
+
+    return names[operation];
+}
+
+juce::String LowLevelGraphicsSVGRenderer::Stats::toChromeTraceJSON() const
+{
+    auto ticksPerMicrosecond =
+        (double)juce::Time::getHighResolutionTicksPerSecond() / 1000000.0;
+
+    auto origin = events.isEmpty() ? 0 : events.getFirst().startTicks;
+    auto end    = 0.0;
+
+    for (auto &e : events)
+        origin = juce::jmin(origin, e.startTicks);
+
+    juce::StringArray entries;
+
+    for (auto &e : events)
+    {
+        auto ts  = (double)(e.startTicks - origin) / ticksPerMicrosecond;
+        auto dur = (double)e.durationTicks / ticksPerMicrosecond;
+
+        end = juce::jmax(end, ts + dur);
+
+        entries.add(
+            "{\"name\":\"" + getOperationName(e.operation) + "\","
+            "\"cat\":\"svg\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+            "\"ts\":" + juce::String(ts, 3) + ","
+            "\"dur\":" + juce::String(dur, 3) + "}"
+        );
+    }
+
+    for (int i = 0; i < numOperations; ++i)
+    {
+        auto &c = operations[i];
+
+        if (c.calls == 0)
+            continue;
+
+        entries.add(
+            "{\"name\":\"" + getOperationName((Operation)i) + "\","
+            "\"cat\":\"svg\",\"ph\":\"C\",\"pid\":1,"
+            "\"ts\":" + juce::String(end, 3) + ","
+            "\"args\":{"
+            "\"calls\":" + juce::String(c.calls) + ","
+            "\"elements\":" + juce::String(c.elements) + ","
+            "\"bytes\":" + juce::String(c.bytes) + ","
+            "\"ms\":" + juce::String(c.getSeconds() * 1000.0, 3) + "}}"
+        );
+    }
+
+    entries.add(
+        "{\"name\":\"defs\",\"cat\":\"svg\",\"ph\":\"C\",\"pid\":1,"
+        "\"ts\":" + juce::String(end, 3) + ","
+        "\"args\":{"
+        "\"created\":" + juce::String(defsCreated) + ","
+        "\"reused\":" + juce::String(defsReused) + "}}"
+    );
+
+    return "{\"traceEvents\":[\n"
+        + entries.joinIntoString(",\n")
+        + "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+const LowLevelGraphicsSVGRenderer::Stats&
+LowLevelGraphicsSVGRenderer::getStats() const
+{
+    stats.scratchHighWaterMark = (juce::int64)scratch.getHighWaterMark();
+    stats.scratchBytesReserved = (juce::int64)scratch.getBytesReserved();
+
+    stats.documentBytesInUse    = (juce::int64)nodes.getBytesInUse();
+    stats.documentHighWaterMark = (juce::int64)nodes.getHighWaterMark();
+    stats.documentBytesReserved = (juce::int64)nodes.getBytesReserved();
+
+    return stats;
+}
+
+void LowLevelGraphicsSVGRenderer::resetStats()
+{
+    stats = Stats();
+}
+
+void LowLevelGraphicsSVGRenderer::setMaxTraceEvents(int maxEvents)
+{
+    jassert(maxEvents >= 0);
+    maxTraceEvents = maxEvents;
+}
+
+#if JUCE_VECTOR_ENABLE_INSTRUMENTATION
+
+LowLevelGraphicsSVGRenderer::ScopedOperation::ScopedOperation(
+    const LowLevelGraphicsSVGRenderer &r,
+    Stats::Operation op)
+    : renderer(r),
+      previous(r.currentOperation),
+      operation(op)
+{
+    renderer.currentOperation = this;
+    startTicks = juce::Time::getHighResolutionTicks();
+}
+
+LowLevelGraphicsSVGRenderer::ScopedOperation::~ScopedOperation()
+{
+    auto duration = juce::Time::getHighResolutionTicks() - startTicks;
+
+    auto &stats   = renderer.stats;
+    auto &counter = stats.operations[operation];
+
+    ++counter.calls;
+    counter.ticks    += duration;
+    counter.elements += elements.size();
+
+    // Measured after the timer is stopped so the estimate isn't included in
+    // the operation's time
+    for (auto e : elements)
+        counter.bytes += estimateSize(*e);
+
+    if (stats.events.size() < renderer.maxTraceEvents)
+    {
+        Stats::Event event = { operation, startTicks, duration };
+        stats.events.add(event);
+    }
+
+    renderer.currentOperation = previous;
+}
+
+#endif
+
+#pragma mark -
+// =============================================================================
+
+void LowLevelGraphicsSVGRenderer::SnapshotCache::clear()
+{
+    fragments.clear();
+    numReused   = 0;
+    numRepainted = 0;
+}
+
+int LowLevelGraphicsSVGRenderer::SnapshotCache::getNumReusedGroups() const
+{
+    return numReused;
+}
+
+int LowLevelGraphicsSVGRenderer::SnapshotCache::getNumRepaintedGroups() const
+{
+    return numRepainted;
+}
+
+void LowLevelGraphicsSVGRenderer::setSnapshotCache(SnapshotCache *cache)
+{
+    // The cache has to be in place before anything is drawn
+    jassert(document->getNumChildElements() == 1);
+    jassert(!indexElements);
+    jassert(memoryBudget == 0);
+
+    snapshotCache = cache;
+}
+
+void LowLevelGraphicsSVGRenderer::setResultCache(SVGResultCache *cache)
+{
+    // The cache has to be in place before anything is drawn
+    jassert(document->getNumChildElements() == 1);
+    jassert(!indexElements);
+    jassert(memoryBudget == 0);
+
+    resultCache = cache;
+    documentHash = OpHash();
+}
+
+void LowLevelGraphicsSVGRenderer::setDefsLibrary(SVGDefsLibrary *library)
+{
+    // Images that were already drawn would stay in the document
+    jassert(numDefs == 0 && document->getChildByName("defs")->getNumChildElements() == 0);
+
+    defsLibrary = library;
+
+    if (defsLibrary)
+        contentAddressedIDs = true;
+}
+
+juce::uint64 LowLevelGraphicsSVGRenderer::getDocumentHash() const
+{
+    if (!resultCache)
+        return 0;
+
+    auto hash = documentHash;
+    hash.next = nullptr;
+
+    hash.add(resultCacheVersion);
+
+    for (int i = 0; i < document->getNumAttributes(); ++i)
+    {
+        hash.add(document->getAttributeName(i).toString());
+        hash.add(juce::String(document->getAttributeValue(i)));
+    }
+
+    hash.add((int)downsampleImages);
+    hash.add(imageOversampling);
+    hash.add(pathTolerance);
+    hash.add((int)precision.mode);
+    hash.add(precision.digits);
+    hash.add(precision.maxError);
+    hash.add((int)contentAddressedIDs);
+    hash.add((int)(snapshotCache != nullptr));
+    hash.add(defsLibrary ? defsLibrary->getURL() : juce::String());
+
+    return hash.value;
+}
+
+void LowLevelGraphicsSVGRenderer::setContentAddressedIDs(bool shouldUse)
+{
+    // Definitions that already exist would keep their numbered IDs
+    jassert(numDefs == 0 && document->getChildByName("defs")->getNumChildElements() == 0);
+
+    contentAddressedIDs = shouldUse;
+}
+
+void LowLevelGraphicsSVGRenderer::writeSnapshot(juce::OutputStream &out)
+{
+    if (!resultCache)
+    {
+        writeDocument(out);
+        return;
+    }
+
+    auto key = getDocumentHash();
+
+    if (resultCache->read(key, out))
+        return;
+
+    encodePendingImages();
+
+    juce::MemoryOutputStream serialized;
+    writeDocument(serialized);
+
+    resultCache->write(key, serialized.getData(), serialized.getDataSize());
+    out.write(serialized.getData(), serialized.getDataSize());
+}
+
+void LowLevelGraphicsSVGRenderer::encodePendingImages()
+{
+    for (auto &pending : pendingImages)
+    {
+        encodeImageData(pending.element, pending.image, pending.isMask);
+    }
+
+    pendingImages.clear();
+}
+
+void LowLevelGraphicsSVGRenderer::writeDocument(juce::OutputStream &out)
+{
+    out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+
+    if (spillStream)
+    {
+        spillStream->flush();
+
+        juce::FileInputStream spilled(spillFile->getFile());
+        jassert(spilled.openedOk());
+
+        FragmentMap unused;
+
+        spillInput = &spilled;
+        writeSnapshotElement(out, *document, unused, nullptr);
+        spillInput = nullptr;
+
+        return;
+    }
+
+    if (!snapshotCache)
+    {
+        FragmentMap unused;
+        writeSnapshotElement(out, *document, unused, nullptr);
+        return;
+    }
+
+    snapshotCache->numReused    = 0;
+    snapshotCache->numRepainted = 0;
+
+    FragmentMap nextFragments;
+    writeSnapshotElement(out, *document, nextFragments, nullptr);
+
+    // Groups that weren't part of this snapshot are dropped from the cache
+    snapshotCache->fragments.swapWith(nextFragments);
+}
+
+#pragma mark -
+// =============================================================================
+
+void LowLevelGraphicsSVGRenderer::setMemoryBudget(juce::int64 maxBytes)
+{
+    // Spilling has to be set up before anything is drawn
+    jassert(document->getNumChildElements() == 1);
+    jassert(!snapshotCache);
+    jassert(!indexElements);
+    jassert(!resultCache);
+
+    spillStream.reset();
+    spillFile.reset();
+
+    memoryBudget = juce::jmax((juce::int64)0, maxBytes);
+
+    if (memoryBudget > 0)
+    {
+        spillFile.reset(new juce::TemporaryFile(".svg"));
+        spillStream.reset(spillFile->getFile().createOutputStream());
+
+        // The temporary file couldn't be opened, so everything stays in memory
+        if (!spillStream)
+        {
+            jassertfalse;
+            spillFile.reset();
+            memoryBudget = 0;
+        }
+    }
+}
+
+void LowLevelGraphicsSVGRenderer::noteFinished(SVGNode *topLevelChild)
+{
+    if (memoryBudget <= 0 || finishedChildren.contains(topLevelChild))
+        return;
+
+    for (auto s : stateStack)
+        if (s->topLevelGroup == topLevelChild)
+            return;
+
+    finishedChildren.add(topLevelChild);
+    finishedBytes += estimateSize(*topLevelChild);
+}
+
+void LowLevelGraphicsSVGRenderer::spillFinishedContent()
+{
+    if (memoryBudget <= 0)
+        return;
+
+    for (auto e : unfinishedChildren)
+    {
+        finishedChildren.add(e);
+        finishedBytes += estimateSize(*e);
+    }
+
+    unfinishedChildren.clearQuick();
+
+    if (finishedBytes < memoryBudget)
+        return;
+
+    juce::SortedSet<const SVGNode*> finished;
+
+    for (auto e : finishedChildren)
+        finished.add(e);
+
+    spillChildren(*document, finished);
+
+    if (auto defs = document->getChildByName("defs"))
+        spillChildren(*defs, finished);
+
+    finishedChildren.clearQuick();
+    finishedBytes = 0;
+
+    // Spilled elements have been deleted
+    clearCoverage();
+}
+
+void LowLevelGraphicsSVGRenderer::spillChildren(
+    SVGNode &parent,
+    const juce::SortedSet<const SVGNode*> &finished)
+{
+    FragmentMap unused;
+    SVGNode *placeholder = nullptr;
+
+    for (auto child = parent.getFirstChildElement(); child;)
+    {
+        auto next = child->getNextElement();
+
+        if (finished.contains(child))
+        {
+            forgetContentDefs(*child);
+
+            auto start = spillStream->getPosition();
+            writeSnapshotElement(*spillStream, *child, unused, nullptr);
+
+            auto end = juce::String(spillStream->getPosition());
+
+            // Neighbouring elements share one placeholder when their text
+            // follows on in the file
+            if (placeholder && placeholder->getStringAttribute(SVGIds::end) == juce::String(start))
+            {
+                placeholder->setAttribute(SVGIds::end, end);
+                parent.removeChildElement(child, true);
+            }
+            else
+            {
+                placeholder = nodes.createElement(spillPlaceholderTag);
+                placeholder->setAttribute(SVGIds::start, juce::String(start));
+                placeholder->setAttribute(SVGIds::end, end);
+
+                parent.replaceChildElement(child, placeholder);
+            }
+        }
+        else
+        {
+            placeholder = child->hasTagName(spillPlaceholderTag) ? child : nullptr;
+        }
+
+        child = next;
+    }
+}
+
+#pragma mark -
+// =============================================================================
+
+void LowLevelGraphicsSVGRenderer::setSpatialIndexing(
+    bool shouldIndex,
+    float cellSize)
+{
+    // The index has to be in place before anything is drawn
+    jassert(document->getNumChildElements() == 1);
+    jassert(!snapshotCache);
+    jassert(!resultCache);
+    jassert(memoryBudget == 0);
+    jassert(cellSize > 0.0f);
+
+    indexElements = shouldIndex;
+    indexCellSize = cellSize;
+
+    auto width  = (float)document->getIntAttribute(SVGIds::width);
+    auto height = (float)document->getIntAttribute(SVGIds::height);
+
+    indexColumns = juce::jmax(1, (int)std::ceil(width  / cellSize));
+    indexRows    = juce::jmax(1, (int)std::ceil(height / cellSize));
+
+    indexEntries.clear();
+    unboundedEntries.clear();
+
+    indexCells.clear();
+    indexCells.insertMultiple(0, {}, shouldIndex ? indexColumns * indexRows : 0);
+}
+
+juce::Array<SVGNode*> LowLevelGraphicsSVGRenderer::getElementsIn(
+    const juce::Rectangle<float> &area) const
+{
+    jassert(indexElements);
+
+    juce::Array<int> entries(unboundedEntries);
+
+    auto columns = getIndexCells(area.getX(), area.getRight(),  indexColumns);
+    auto rows    = getIndexCells(area.getY(), area.getBottom(), indexRows);
+
+    for (int y = rows.getStart(); y < rows.getEnd(); ++y)
+        for (int x = columns.getStart(); x < columns.getEnd(); ++x)
+            entries.addArray(indexCells.getReference(y * indexColumns + x));
+
+    // Entries are numbered in drawing order, and elements that span several
+    // cells are listed once for each of them
+    entries.sort();
+
+    juce::Array<SVGNode*> elements;
+    int previous = -1;
+
+    for (auto entry : entries)
+    {
+        if (entry == previous)
+            continue;
+
+        previous = entry;
+        auto &e = indexEntries.getReference(entry);
+
+        if (e.element && (!e.hasBounds || e.bounds.intersects(area)))
+            elements.add(e.element);
+    }
+
+    return elements;
+}
+
+juce::Array<SVGNode*> LowLevelGraphicsSVGRenderer::getElementsAt(
+    juce::Point<float> p) const
+{
+    jassert(indexElements);
+
+    juce::Array<SVGNode*> elements;
+
+    auto column = getIndexCells(p.x, p.x, indexColumns).getStart();
+    auto row    = getIndexCells(p.y, p.y, indexRows).getStart();
+
+    auto &cell = indexCells.getReference(row * indexColumns + column);
+
+    for (int i = cell.size(); --i >= 0;)
+    {
+        auto &e = indexEntries.getReference(cell.getUnchecked(i));
+
+        if (e.element && e.bounds.contains(p))
+            elements.add(e.element);
+    }
+
+    return elements;
+}
+
+void LowLevelGraphicsSVGRenderer::extractRegion(
+    const juce::Rectangle<float> &area,
+    juce::XmlElement *svgDocument,
+    bool includeImages) const
+{
+    jassert(svgDocument->getTagName().toLowerCase() == "svg");
+    jassert(svgDocument->getNumChildElements() == 0);
+
+    svgDocument->setAttribute(SVGIds::xmlns, "http://www.w3.org/2000/svg");
+    svgDocument->setAttribute(SVGIds::xmlnsXlink, "http://www.w3.org/1999/xlink");
+
+    svgDocument->setAttribute(SVGIds::width,  writeCoordinate(area.getWidth()));
+    svgDocument->setAttribute(SVGIds::height, writeCoordinate(area.getHeight()));
+    svgDocument->setAttribute(
+        SVGIds::viewBox,
+        writeCoordinate(area.getX()) + " "
+            + writeCoordinate(area.getY()) + " "
+            + writeCoordinate(area.getWidth()) + " "
+            + writeCoordinate(area.getHeight())
+    );
+
+    juce::SortedSet<const SVGNode*> selected;
+
+    for (auto e : getElementsIn(area))
+        selected.add(e);
+
+    auto defs = svgDocument->createNewChildElement("defs");
+
+    juce::Array<const SVGNode*> sourceDefs;
+    copyRegion(*document, *svgDocument, selected, sourceDefs);
+
+    // Only the defs that the copied elements use are copied, so the others
+    // are never deep-copied. Defs can refer to other defs, so the references
+    // of each one that's used are followed in turn.
+    juce::HashMap<juce::String, const SVGNode*> defsByID;
+
+    for (auto def : sourceDefs)
+        defsByID.set(def->getStringAttribute(SVGIds::id), def);
+
+    juce::SortedSet<juce::String> used;
+    findRefs(*svgDocument, used);
+
+    juce::StringArray pending;
+
+    for (int i = 0; i < used.size(); ++i)
+        pending.add(used[i]);
+
+    while (pending.size() > 0)
+    {
+        auto def = defsByID[pending[pending.size() - 1]];
+        pending.remove(pending.size() - 1);
+
+        if (!def)
+            continue;
+
+        juce::SortedSet<juce::String> refs;
+        findRefs(*def, refs);
+
+        for (int i = 0; i < refs.size(); ++i)
+            if (used.add(refs[i]))
+                pending.add(refs[i]);
+    }
+
+    // Defs from every group end up in the one <defs>, in document order
+    for (auto def : sourceDefs)
+        if (used.contains(def->getStringAttribute(SVGIds::id))
+            && (includeImages || !def->hasTagName("image")))
+            defs->addChildElement(def->createXmlElement());
+}
+
+void LowLevelGraphicsSVGRenderer::extractImages(juce::XmlElement *svgDocument) const
+{
+    jassert(svgDocument->getTagName().toLowerCase() == "svg");
+    jassert(svgDocument->getNumChildElements() == 0);
+
+    svgDocument->setAttribute(SVGIds::xmlns, "http://www.w3.org/2000/svg");
+    svgDocument->setAttribute(SVGIds::xmlnsXlink, "http://www.w3.org/1999/xlink");
+
+    auto sharedDefs = svgDocument->createNewChildElement("defs");
+
+    // Groups can keep defs of their own
+    juce::Array<const SVGNode*> elements;
+    elements.add(document);
+
+    while (elements.size() > 0)
+    {
+        auto e = elements.removeAndReturn(elements.size() - 1);
+
+        for (auto child = e->getFirstChildElement(); child; child = child->getNextElement())
+        {
+            if (child->hasTagName("defs"))
+            {
+                for (auto def = child->getFirstChildElement(); def; def = def->getNextElement())
+                    if (def->hasTagName("image"))
+                        sharedDefs->addChildElement(def->createXmlElement());
+            }
+            else if (child->hasTagName("g"))
+            {
+                elements.add(child);
+            }
+        }
+    }
+}
+
+void LowLevelGraphicsSVGRenderer::findRefs(
+    const SVGNode &e,
+    juce::SortedSet<juce::String> &refs)
+{
+    for (int i = 0; i < e.getNumAttributes(); ++i)
+        addRef(e.getAttributeValue(i), refs);
+
+    for (auto child = e.getFirstChildElement(); child; child = child->getNextElement())
+        if (!child->isTextElement())
+            findRefs(*child, refs);
+}
+
+void LowLevelGraphicsSVGRenderer::findRefs(
+    const juce::XmlElement &e,
+    juce::SortedSet<juce::String> &refs)
+{
+    for (int i = 0; i < e.getNumAttributes(); ++i)
+        addRef(e.getAttributeValue(i), refs);
+
+    for (auto child = e.getFirstChildElement(); child; child = child->getNextElement())
+        if (!child->isTextElement())
+            findRefs(*child, refs);
+}
+
+void LowLevelGraphicsSVGRenderer::addRef(
+    const juce::String &value,
+    juce::SortedSet<juce::String> &refs)
+{
+    // References are either an xlink:href="#id" or a url(#id)
+    if (value.startsWithChar('#'))
+        refs.add(value.substring(1));
+    else if (value.startsWith("url(#"))
+        refs.add(
+            value.fromFirstOccurrenceOf("#", false, false)
+                 .upToFirstOccurrenceOf(")", false, false)
+        );
+}
+
+juce::Range<int> LowLevelGraphicsSVGRenderer::getIndexCells(
+    float start,
+    float end,
+    int numCells) const
+{
+    auto first = juce::jlimit(0, numCells - 1, (int)std::floor(start / indexCellSize));
+    auto last  = juce::jlimit(0, numCells - 1, (int)std::floor(end   / indexCellSize));
+
+    return { first, last + 1 };
+}
+
+void LowLevelGraphicsSVGRenderer::copyRegion(
+    const SVGNode &source,
+    juce::XmlElement &dest,
+    const juce::SortedSet<const SVGNode*> &selected,
+    juce::Array<const SVGNode*> &defs) const
+{
+    // Selected elements are copied whole, and groups are only copied (without
+    // their other children) when something inside them is selected. Defs are
+    // collected rather than copied, so that only the used ones are copied.
+    for (auto child = source.getFirstChildElement(); child; child = child->getNextElement())
+    {
+        if (child->hasTagName("defs"))
+        {
+            for (auto def = child->getFirstChildElement(); def; def = def->getNextElement())
+                defs.add(def);
+        }
+        else if (selected.contains(child))
+        {
+            dest.addChildElement(child->createXmlElement());
+        }
+        else if (child->hasTagName("g"))
+        {
+            auto group = new juce::XmlElement("g");
+
+            for (int i = 0; i < child->getNumAttributes(); ++i)
+                group->setAttribute(child->getAttributeName(i), juce::String(child->getAttributeValue(i)));
+
+            copyRegion(*child, *group, selected, defs);
+
+            if (group->getNumChildElements() > 0)
+                dest.addChildElement(group);
+            else
+                delete group;
+        }
+    }
+}
+
+void LowLevelGraphicsSVGRenderer::finishSnapshotGroup(const OpenGroup &group)
+{
+    auto &fragments = snapshotCache->fragments;
+
+    if (fragments.contains(group.key)
+        && fragments[group.key].hash == group.hash.value)
+    {
+        // The previous snapshot's text for this group is still valid, so the
+        // elements that were just built can be thrown away
+        for (auto child = group.element->getFirstChildElement(); child; child = child->getNextElement())
+            forgetContentDefs(*child);
+
+        group.element->deleteAllChildElements();
+        group.element->setAttribute(snapshotReuseAttribute, "1");
+    }
+    else
+    {
+        groupHashes.set(group.key, group.hash.value);
+    }
+
+    group.element->setAttribute(snapshotKeyAttribute, group.key);
+}
+
+void LowLevelGraphicsSVGRenderer::writeSnapshotElement(
+    juce::OutputStream &out,
+    const SVGNode &e,
+    FragmentMap &nextFragments,
+    juce::StringArray *groupKeys)
+{
+    if (e.isTextElement())
+    {
+        writeEscaped(out, e.getText(), false);
+        return;
+    }
+
+    if (spillInput && e.hasTagName(spillPlaceholderTag))
+    {
+        auto start = e.getStringAttribute(SVGIds::start).getLargeIntValue();
+        auto end   = e.getStringAttribute(SVGIds::end).getLargeIntValue();
+
+        spillInput->setPosition(start);
+        out.writeFromInputStream(*spillInput, end - start);
+        return;
+    }
+
+    if (e.hasAttribute(snapshotKeyAttribute))
+    {
+        auto key = e.getStringAttribute(snapshotKeyAttribute);
+
+        if (groupKeys)
+            groupKeys->add(key);
+
+        if (e.hasAttribute(snapshotReuseAttribute))
+        {
+            auto fragment = snapshotCache->fragments[key];
+            out << fragment.text;
+
+            keepFragment(key, nextFragments);
+            ++snapshotCache->numReused;
+            return;
+        }
+
+        SnapshotCache::Fragment fragment;
+        fragment.hash = groupHashes[key];
+
+        juce::MemoryOutputStream text;
+        writeSnapshotTag(text, e, nextFragments, &fragment.childKeys);
+
+        fragment.text = text.toUTF8();
+        out << fragment.text;
+
+        nextFragments.set(key, fragment);
+        ++snapshotCache->numRepainted;
+        return;
+    }
+
+    writeSnapshotTag(out, e, nextFragments, groupKeys);
+}
+
+void LowLevelGraphicsSVGRenderer::writeSnapshotTag(
+    juce::OutputStream &out,
+    const SVGNode &e,
+    FragmentMap &nextFragments,
+    juce::StringArray *groupKeys)
+{
+    out << "<" << e.getTagName();
+
+    for (int i = 0; i < e.getNumAttributes(); ++i)
+    {
+        auto &name = e.getAttributeName(i);
+
+        if (name == juce::StringRef(snapshotKeyAttribute)
+            || name == juce::StringRef(snapshotReuseAttribute))
+            continue;
+
+        out << " " << name.toString() << "=\"";
+        writeEscaped(out, e.getAttributeValue(i), true);
+        out << "\"";
+    }
+
+    if (!e.getFirstChildElement())
+    {
+        out << "/>";
+        return;
+    }
+
+    out << ">";
+
+    for (auto child = e.getFirstChildElement(); child; child = child->getNextElement())
+        writeSnapshotElement(out, *child, nextFragments, groupKeys);
+
+    out << "</" << e.getTagName() << ">";
+}
+
+void LowLevelGraphicsSVGRenderer::keepFragment(
+    const juce::String &key,
+    FragmentMap &nextFragments)
+{
+    auto fragment = snapshotCache->fragments[key];
+    nextFragments.set(key, fragment);
+
+    // Reused text includes any groups nested inside of it
+    for (auto &childKey : fragment.childKeys)
+        keepFragment(childKey, nextFragments);
+}
+
+void LowLevelGraphicsSVGRenderer::writeEscaped(
+    juce::OutputStream &out,
+    juce::StringRef s,
+    bool isAttribute)
+{
+    // Node text is UTF-8 already, so the runs between the characters that
+    // need escaping are written straight from it
+    auto start = s.text.getAddress();
+    auto run   = start;
+
+    for (auto c = start; *c != 0; ++c)
+    {
+        const char *entity = nullptr;
+
+        switch (*c)
+        {
+            case '&':  entity = "&amp;"; break;
+            case '<':  entity = "&lt;";  break;
+            case '>':  entity = "&gt;";  break;
+            case '"':  entity = isAttribute ? "&quot;" : nullptr; break;
+            case '\r': entity = isAttribute ? "&#13;"  : nullptr; break;
+            case '\n': entity = isAttribute ? "&#10;"  : nullptr; break;
+            case '\t': entity = isAttribute ? "&#9;"   : nullptr; break;
+            default:   break;
+        }
+
+        if (!entity)
+            continue;
+
+        out.write(run, (size_t)(c - run));
+        out << entity;
+
+        run = c + 1;
+    }
+
+    out.write(run, std::strlen(run));
+}
+
+#pragma mark -
+// =============================================================================
+
+void LowLevelGraphicsSVGRenderer::OpHash::add(const void *data, size_t numBytes)
+{
+    value = hashBytes(data, numBytes, value);
+
+    if (next)
+        next->add(data, numBytes);
+}
+
+void LowLevelGraphicsSVGRenderer::OpHash::add(int i)
+{
+    add(&i, sizeof(i));
+}
+
+void LowLevelGraphicsSVGRenderer::OpHash::add(float f)
+{
+    add(&f, sizeof(f));
+}
+
+void LowLevelGraphicsSVGRenderer::OpHash::add(juce::uint64 i)
+{
+    add(&i, sizeof(i));
+}
+
+void LowLevelGraphicsSVGRenderer::OpHash::add(const juce::String &s)
+{
+    add(s.toRawUTF8(), s.getNumBytesAsUTF8());
+    add((int)s.getNumBytesAsUTF8());
+}
+
+void LowLevelGraphicsSVGRenderer::OpHash::add(const juce::Rectangle<int> &r)
+{
+    const int values[] = { r.getX(), r.getY(), r.getWidth(), r.getHeight() };
+    add(values, sizeof(values));
+}
+
+void LowLevelGraphicsSVGRenderer::OpHash::add(const juce::Rectangle<float> &r)
+{
+    const float values[] = { r.getX(), r.getY(), r.getWidth(), r.getHeight() };
+    add(values, sizeof(values));
+}
+
+void LowLevelGraphicsSVGRenderer::OpHash::add(const juce::RectangleList<int> &r)
+{
+    add(r.getNumRectangles());
+
+    for (auto &rect : r)
+        add(rect);
+}
+
+void LowLevelGraphicsSVGRenderer::OpHash::add(const juce::AffineTransform &t)
+{
+    const float values[] = { t.mat00, t.mat01, t.mat02, t.mat10, t.mat11, t.mat12 };
+    add(values, sizeof(values));
+}
+
+void LowLevelGraphicsSVGRenderer::OpHash::add(const juce::Path &p)
+{
+    add((int)p.isUsingNonZeroWinding());
+
+    juce::Path::Iterator i(p);
+
+    while (i.next())
+    {
+        add((int)i.elementType);
+
+        switch (i.elementType)
+        {
+            case juce::Path::Iterator::cubicTo:
+                add(i.x3);
+                add(i.y3);
+                // fall through
+            case juce::Path::Iterator::quadraticTo:
+                add(i.x2);
+                add(i.y2);
+                // fall through
+            case juce::Path::Iterator::startNewSubPath:
+            case juce::Path::Iterator::lineTo:
+                add(i.x1);
+                add(i.y1);
+                break;
+
+            case juce::Path::Iterator::closePath:
+                break;
+        }
+    }
+}
+
+void LowLevelGraphicsSVGRenderer::OpHash::add(const juce::FillType &f)
+{
+    add((juce::uint64)f.colour.getARGB());
+    add(f.getOpacity());
+    add(f.transform);
+
+    if (f.isTiledImage())
+        add(hashImage(f.image));
+
+    if (f.isGradient())
+    {
+        auto &g = *f.gradient;
+
+        add((int)g.isRadial);
+        add(g.point1.x);
+        add(g.point1.y);
+        add(g.point2.x);
+        add(g.point2.y);
+
+        for (int i = 0; i < g.getNumColours(); ++i)
+        {
+            add((juce::uint64)g.getColour(i).getARGB());
+            add((float)g.getColourPosition(i));
+        }
+    }
+}
+
+void LowLevelGraphicsSVGRenderer::OpHash::add(const juce::Font &f)
+{
+    add(f.getTypefaceName());
+    add(f.getTypefaceStyle());
+    add(f.getHeight());
+    add(f.getHorizontalScale());
+}
+
+void LowLevelGraphicsSVGRenderer::OpHash::add(const juce::StringPairArray &s)
+{
+    auto &keys   = s.getAllKeys();
+    auto &values = s.getAllValues();
+
+    for (int i = 0; i < s.size(); ++i)
+    {
+        add(keys[i]);
+        add(values[i]);
+    }
+}
+
+juce::String LowLevelGraphicsSVGRenderer::OpenGroup::getIDPrefix() const
+{
+    auto keyHash = hashBytes(key.toRawUTF8(), key.getNumBytesAsUTF8(), 0);
+    return "G" + juce::String::toHexString((juce::int64)keyHash) + "-";
+}
+
+LowLevelGraphicsSVGRenderer::OpHash* LowLevelGraphicsSVGRenderer::hashOp(
+    Stats::Operation operation)
+{
+    OpHash *hash = nullptr;
+
+    if (snapshotCache && !openGroups.isEmpty())
+        hash = &openGroups.getReference(openGroups.size() - 1).hash;
+    else if (resultCache)
+        hash = &documentHash;
+
+    if (hash)
+        hash->add((int)operation);
+
+    return hash;
+}
+
+void LowLevelGraphicsSVGRenderer::hashState(OpHash &hash)
+{
+    hash.add(state->xOffset);
+    hash.add(state->yOffset);
+    hash.add(state->transform);
+    hash.add(state->clipRegions);
+    hash.add(state->clipPath);
+    hash.add((int)state->clipIsRectangles);
+    hash.add(state->fillType);
+    hash.add(state->font);
+    hash.add(state->tags);
+    hash.add((int)resampleQuality);
+    hash.add((int)precision.mode);
+    hash.add(precision.digits);
+    hash.add(precision.maxError);
+}
+
+juce::String LowLevelGraphicsSVGRenderer::getDefScope() const
+{
+    if (!snapshotCache || openGroups.isEmpty())
+        return {};
+
+    return openGroups.getLast().key + ":";
+}
+
+#pragma mark -
+// =============================================================================
+
+juce::String LowLevelGraphicsSVGRenderer::truncateFloat(
+    float value,
+    int maxDecimalPlaces)
+{
+    char text[SVGKernels::maxNumberLength + 1];
+    auto length = SVGKernels::formatNumber(value, maxDecimalPlaces, text);
+
+    return juce::String(text, (size_t)length);
+}
+
+int LowLevelGraphicsSVGRenderer::getDecimalPlaces(float value) const
+{
+    return precision.getDecimalPlaces(
+        value,
+        canvasSize,
+        state->transform.getScaleFactor()
+    );
+}
+
+juce::String LowLevelGraphicsSVGRenderer::writeCoordinate(
+    float value,
+    int extraDecimalPlaces) const
+{
+    return truncateFloat(value, getDecimalPlaces(value) + extraDecimalPlaces);
+}
+
+juce::String LowLevelGraphicsSVGRenderer::getPreviousGradientRef(
+    juce::ColourGradient *g)
+{
+    auto scope = getDefScope();
+
+    for (auto r : previousGradients)
+    {
+        auto previousGradient = &r.gradient;
+
+        if (r.scope != scope)
+            continue;
+
+        if (previousGradient->getNumColours() != g->getNumColours())
+            continue;
+
+        bool match = false;
+
+        for (int i = 0; i < previousGradient->getNumColours(); ++i)
+        {
+            auto colour = previousGradient->getColour(i);
+            auto pos    = previousGradient->getColourPosition(i);
+
+            if (g->getColour(i) != colour)
+                break;
+
+            if (g->getColourPosition(i) != pos)
+                break;
+
+            match = true;
+        }
+
+        if (match)
+            return r.ref;
+    }
+
+    return "";
+}
+
+LowLevelGraphicsSVGRenderer::TransformType
+LowLevelGraphicsSVGRenderer::classifyTransform(const juce::AffineTransform &t)
+{
+    if (t.mat01 != 0.0f || t.mat10 != 0.0f)
+        return TransformType::general;
+
+    if (t.mat00 != 1.0f || t.mat11 != 1.0f)
+        return TransformType::scale;
+
+    if (t.mat02 != 0.0f || t.mat12 != 0.0f)
+        return TransformType::translation;
+
+    return TransformType::identity;
+}
+
+bool LowLevelGraphicsSVGRenderer::isUniformScale(const juce::AffineTransform &t)
+{
+    auto type = classifyTransform(t);
+
+    return type == TransformType::identity
+        || type == TransformType::translation
+        || (type == TransformType::scale && t.mat00 == t.mat11);
+}
+
+juce::String LowLevelGraphicsSVGRenderer::writeTransform(
+    const juce::AffineTransform &t) const
+{
+    // Scale factors and matrix coefficients get more decimal places than
+    // coordinates, as their errors are multiplied by the coordinates
+    auto writeTranslation = [this, &t]
+    {
+        auto string = "translate(" + writeCoordinate(t.mat02);
+
+        if (t.mat12 != 0.0f)
+            string << "," << writeCoordinate(t.mat12);
+
+        return string + ")";
+    };
+
+    switch (classifyTransform(t))
+    {
+        case TransformType::identity:
+            return {};
+
+        case TransformType::translation:
+            return writeTranslation();
+
+        case TransformType::scale:
+        {
+            auto string = "scale(" + writeCoordinate(t.mat00, 2);
+
+            if (t.mat11 != t.mat00)
+                string << "," << writeCoordinate(t.mat11, 2);
+
+            string << ")";
+
+            if (t.mat02 != 0.0f || t.mat12 != 0.0f)
+                return writeTranslation() + " " + string;
+
+            return string;
+        }
+
+        case TransformType::general:
+            break;
+    }
+
+    // SVG lists the matrix column by column
+    return "matrix("
+        + writeCoordinate(t.mat00, 2) + "," + writeCoordinate(t.mat10, 2) + ","
+        + writeCoordinate(t.mat01, 2) + "," + writeCoordinate(t.mat11, 2) + ","
+        + writeCoordinate(t.mat02)    + "," + writeCoordinate(t.mat12)    + ")";
+}
+
+juce::String LowLevelGraphicsSVGRenderer::writePath(
+    const juce::Path &p,
+    const juce::AffineTransform &t,
+    juce::Rectangle<float> *bounds)
+{
+    // Points are gathered into one packed array so that they can be
+    // transformed in a single pass, rather than copying and transforming the
+    // whole path before it's written. The arrays and the text are sized with
+    // a counting pass and live in the scratch arena, so the only allocation
+    // left is the returned string.
+    SVGArena::ScopedRewind rewind(scratch);
+
+    size_t numCommands = 0, numPoints = 0;
+
+    {
+        juce::Path::Iterator i(p);
+
+        while (i.next())
+        {
+            ++numCommands;
+
+            switch (i.elementType)
+            {
+                case juce::Path::Iterator::startNewSubPath:
+                case juce::Path::Iterator::lineTo:      numPoints += 2; break;
+                case juce::Path::Iterator::quadraticTo: numPoints += 4; break;
+                case juce::Path::Iterator::cubicTo:     numPoints += 6; break;
+                case juce::Path::Iterator::closePath:   break;
+            }
+        }
+    }
+
+    if (numCommands == 0)
+        return {};
+
+    auto *commands = scratch.allocateArray<char>(numCommands);
+    auto *points   = scratch.allocateArray<float>(juce::jmax(numPoints, (size_t)1));
+
+    {
+        juce::Path::Iterator i(p);
+
+        auto *command = commands;
+        auto *point   = points;
+
+        while (i.next())
+        {
+            switch (i.elementType)
+            {
+                case juce::Path::Iterator::startNewSubPath:
+                    *command++ = 'M';
+                    *point++ = i.x1; *point++ = i.y1;
+                    break;
+
+                case juce::Path::Iterator::lineTo:
+                    *command++ = 'L';
+                    *point++ = i.x1; *point++ = i.y1;
+                    break;
+
+                case juce::Path::Iterator::quadraticTo:
+                    *command++ = 'Q';
+                    *point++ = i.x1; *point++ = i.y1;
+                    *point++ = i.x2; *point++ = i.y2;
+                    break;
+
+                case juce::Path::Iterator::cubicTo:
+                    *command++ = 'C';
+                    *point++ = i.x1; *point++ = i.y1;
+                    *point++ = i.x2; *point++ = i.y2;
+                    *point++ = i.x3; *point++ = i.y3;
+                    break;
+
+                case juce::Path::Iterator::closePath:
+                    *command++ = 'Z';
+                    break;
+            }
+        }
+    }
+
+    if (!t.isIdentity())
+        SVGKernels::transformPoints(points, points, (int)numPoints / 2, t);
+
+    // The bounds of the control points contain the bounds of the curves
+    if (bounds && numPoints >= 2)
+    {
+        auto left = points[0], right  = left;
+        auto top  = points[1], bottom = top;
+
+        for (size_t n = 2; n + 1 < numPoints; n += 2)
+        {
+            left   = juce::jmin(left,   points[n]);
+            right  = juce::jmax(right,  points[n]);
+            top    = juce::jmin(top,    points[n + 1]);
+            bottom = juce::jmax(bottom, points[n + 1]);
+        }
+
+        *bounds = juce::Rectangle<float>::leftTopRightBottom(left, top, right, bottom);
+    }
+
+    // Each number takes its separator as well as its text, and the last one
+    // may be followed by a terminator
+    auto *const text = scratch.allocateArray<char>(
+        numPoints * (SVGKernels::maxNumberLength + 1) + numCommands * 2 + 1
+    );
+
+    auto *d = text;
+
+    // Fixed and automatic precision use the same places for every number,
+    // so they're only worked out once
+    auto decimalPlaces = precision.mode == PrecisionPolicy::Mode::significantDigits
+        ? -1
+        : getDecimalPlaces(0.0f);
+
+    auto *point = points;
+
+    for (size_t n = 0; n < numCommands; ++n)
+    {
+        auto command = commands[n];
+
+        if (n > 0)
+            *d++ = ' ';
+
+        *d++ = command;
+
+        auto numValues = command == 'C' ? 6 : (command == 'Q' ? 4 : (command == 'Z' ? 0 : 2));
+
+        for (int v = 0; v < numValues; ++v, ++point)
+        {
+            *d++ = ' ';
+            d += SVGKernels::formatNumber(
+                *point,
+                decimalPlaces >= 0 ? decimalPlaces : getDecimalPlaces(*point),
+                d
+            );
+        }
+    }
+
+    return juce::String(text, (size_t)(d - text));
+}
+
+juce::String LowLevelGraphicsSVGRenderer::writeColour(const juce::Colour &c)
+{
+    auto rgb = (int)(c.getARGB() & 0xffffff);
+
+    if (colourStrings.contains(rgb))
+        return colourStrings[rgb];
+
+    static constexpr const char* hexDigits = "0123456789abcdef";
+
+    auto red   = c.getRed();
+    auto green = c.getGreen();
+    auto blue  = c.getBlue();
+
+    char text[7] = { '#' };
+    size_t length;
+
+    // Channels made of a repeated digit (e.g. 0x33) can use the short form
+    if (red % 17 == 0 && green % 17 == 0 && blue % 17 == 0)
+    {
+        text[1] = hexDigits[red   / 17];
+        text[2] = hexDigits[green / 17];
+        text[3] = hexDigits[blue  / 17];
+        length  = 4;
+    }
+    else
+    {
+        text[1] = hexDigits[red   >> 4];
+        text[2] = hexDigits[red   & 15];
+        text[3] = hexDigits[green >> 4];
+        text[4] = hexDigits[green & 15];
+        text[5] = hexDigits[blue  >> 4];
+        text[6] = hexDigits[blue  & 15];
+        length  = 7;
+    }
+
+    // Animated or sampled colours shouldn't grow the cache without limit
+    if (colourStrings.size() >= maxCachedColours)
+        colourStrings.clear();
+
+    juce::String string(text, length);
+    colourStrings.set(rgb, string);
+
+    return string;
+}
+
+juce::String LowLevelGraphicsSVGRenderer::writeOpacity(float opacity)
+{
+    // Colour fills keep their opacity as an 8-bit alpha, so nearly every
+    // opacity written is one of 256 values
+    auto alpha = juce::roundToInt(opacity * 255.0f);
+
+    if (alpha < 0 || alpha > 255 || (float)alpha / 255.0f != opacity)
+        return truncateFloat(opacity);
+
+    auto &string = opacityStrings[alpha];
+
+    if (string.isEmpty())
+        string = truncateFloat(opacity);
+
+    return string;
+}
+
+void LowLevelGraphicsSVGRenderer::applyOpacity(
+    SVGNode *e,
+    const juce::Identifier &attribute,
+    float opacity)
+{
+    // Fully opaque is the default, and most fills are
+    if (opacity < 1.0f)
+        e->setAttribute(attribute, writeOpacity(opacity));
+}
+
+juce::String LowLevelGraphicsSVGRenderer::writeFill()
+{
+    if (state->fillType.isGradient() || state->fillType.isTiledImage())
+        return state->fillURL;
+    else
+        return writeColour(state->fillType.colour);
+}
+
+juce::String LowLevelGraphicsSVGRenderer::writeImageQuality()
+{
+    switch (resampleQuality)
+    {
+        case juce::Graphics::lowResamplingQuality:
             return "optimizeSpeed";
 
-        case juce::Graphics::mediumResamplingQuality:
-            return "auto";
+        case juce::Graphics::mediumResamplingQuality:
+            return "auto";
+
+        case juce::Graphics::highResamplingQuality:
+            return "optimizeQuality";
+    }
+}
+
+juce::String LowLevelGraphicsSVGRenderer::getImageRef(
+    const juce::Image &i,
+    juce::uint64 imageHash,
+    const juce::AffineTransform &t)
+{
+    auto width  = i.getWidth();
+    auto height = i.getHeight();
+
+    if (downsampleImages)
+    {
+        // The transformed unit vectors give the number of output pixels that
+        // a single image pixel covers along each axis
+        auto scaleX = std::sqrt(t.mat00 * t.mat00 + t.mat10 * t.mat10);
+        auto scaleY = std::sqrt(t.mat01 * t.mat01 + t.mat11 * t.mat11);
+
+        width = juce::jlimit(
+            1,
+            i.getWidth(),
+            (int)std::ceil(i.getWidth() * scaleX * imageOversampling)
+        );
+
+        height = juce::jlimit(
+            1,
+            i.getHeight(),
+            (int)std::ceil(i.getHeight() * scaleY * imageOversampling)
+        );
+    }
+
+    auto key = getDefScope()
+        + juce::String::toHexString((juce::int64)imageHash)
+        + juce::String::formatted("_%dx%d", width, height);
+
+    if (imageRefs.contains(key))
+    {
+        noteDefReused();
+        return imageRefs[key];
+    }
+
+    auto image = createDef("image", "Image");
+
+    image->setAttribute(SVGIds::width, i.getWidth());
+    image->setAttribute(SVGIds::height, i.getHeight());
+
+    juce::Image encoded(i);
+
+    if (width != i.getWidth() || height != i.getHeight())
+    {
+        encoded = i.rescaled(
+            width,
+            height,
+            juce::Graphics::highResamplingQuality
+        );
+
+        // Rounding the target size can change the aspect ratio slightly
+        image->setAttribute(SVGIds::preserveAspectRatio, "none");
+    }
+
+    applyImageData(image, encoded, false);
+
+    auto imageRef = finishDef(image);
+    imageRefs.set(key, imageRef);
+    return imageRef;
+}
+
+juce::String LowLevelGraphicsSVGRenderer::getPatternRef(
+    const juce::FillType &fill)
+{
+    auto &image = fill.image;
+
+    // The fill's transform places the image in the context's coordinates,
+    // in the same way as a gradient's points
+    auto transform = fill.transform
+        .translated((float)state->xOffset, (float)state->yOffset)
+        .followedBy(state->transform);
+
+    auto imageRef = getImageRef(image, hashImage(image), transform);
+    auto patternTransform = writeTransform(transform);
+
+    // Fills that tile the same image in the same place share a pattern, and
+    // every pattern of the image shares its embedded data
+    auto key = getDefScope() + imageRef + "@" + patternTransform
+        + "," + juce::String((int)resampleQuality);
+
+    if (patternRefs.contains(key))
+    {
+        noteDefReused();
+        return patternRefs[key];
+    }
+
+    auto pattern = createDef("pattern", "Pattern");
+
+    pattern->setAttribute(SVGIds::patternUnits, "userSpaceOnUse");
+    pattern->setAttribute(SVGIds::width, image.getWidth());
+    pattern->setAttribute(SVGIds::height, image.getHeight());
+
+    if (patternTransform.isNotEmpty())
+        pattern->setAttribute(SVGIds::patternTransform, patternTransform);
+
+    auto use = pattern->createNewChildElement("use");
+    use->setAttribute(SVGIds::imageRendering, writeImageQuality());
+    use->setAttribute(SVGIds::xlinkHref, imageRef);
+
+    auto patternRef = finishDef(pattern);
+    patternRefs.set(key, patternRef);
+    return patternRef;
+}
+
+SVGNode* LowLevelGraphicsSVGRenderer::createElement(
+    const juce::String &tagName)
+{
+    auto e = (state->clipGroup)
+        ? state->clipGroup->createNewChildElement(tagName)
+        : document->createNewChildElement(tagName);
+
+   #if JUCE_VECTOR_ENABLE_INSTRUMENTATION
+    if (currentOperation)
+        currentOperation->elements.add(e);
+   #endif
+
+    // Elements drawn straight into the document are finished as soon as the
+    // drawing operation is
+    if (memoryBudget > 0 && (!state->clipGroup || state->clipGroup == document))
+        unfinishedChildren.add(e);
+
+    // Elements count as unbounded until noteElementBounds() is called
+    if (indexElements)
+    {
+        unboundedEntries.add(indexEntries.size());
+        indexEntries.add({ e, {}, false });
+    }
+
+    return e;
+}
+
+void LowLevelGraphicsSVGRenderer::noteElementBounds(
+    SVGNode *e,
+    const juce::Rectangle<float> &bounds)
+{
+    auto container = state->clipGroup ? state->clipGroup : document;
+    auto c = coverageByContainer[container];
+
+    if (!c)
+    {
+        c = coverage.add(new Coverage());
+        c->container = container;
+        coverageByContainer.set(container, c);
+    }
+
+    int entry = -1;
+
+    if (indexElements)
+    {
+        // The element is nearly always the last one that was created
+        for (int i = unboundedEntries.size(); --i >= 0;)
+        {
+            entry = unboundedEntries.getUnchecked(i);
+
+            if (indexEntries.getReference(entry).element == e)
+            {
+                unboundedEntries.remove(i);
+                break;
+            }
+
+            entry = -1;
+        }
+
+        if (entry >= 0)
+        {
+            indexEntries.getReference(entry).bounds    = bounds;
+            indexEntries.getReference(entry).hasBounds = true;
+
+            auto columns = getIndexCells(bounds.getX(), bounds.getRight(),  indexColumns);
+            auto rows    = getIndexCells(bounds.getY(), bounds.getBottom(), indexRows);
+
+            for (int y = rows.getStart(); y < rows.getEnd(); ++y)
+                for (int x = columns.getStart(); x < columns.getEnd(); ++x)
+                    indexCells.getReference(y * indexColumns + x).add(entry);
+        }
+    }
+
+    auto cell = getCoverageCell(
+        getCoverageIndex(bounds.getX()),
+        getCoverageIndex(bounds.getY())
+    );
+
+    c->cells.getReference(cell).add({ e, bounds, entry });
+}
+
+bool LowLevelGraphicsSVGRenderer::isOpaque(const juce::FillType &fill)
+{
+    // FillType has no opacity test of its own, and its overall opacity
+    // applies on top of whatever the colour, gradient or image holds
+    if (fill.getOpacity() < 1.0f)
+        return false;
+
+    if (fill.isColour())
+        return fill.colour.getAlpha() == 255;
+
+    if (fill.isGradient())
+        return fill.gradient->isOpaque();
+
+    if (fill.isTiledImage())
+        return fill.image.isValid() && !fill.image.hasAlphaChannel();
+
+    return false;
+}
+
+void LowLevelGraphicsSVGRenderer::removeCoveredElements(
+    const juce::Rectangle<float> &area)
+{
+    // Only elements in the same container can be removed, since anything
+    // outside of it may be clipped, masked or composited differently
+    auto container = state->clipGroup ? state->clipGroup : document;
+    auto c = coverageByContainer[container];
+
+    if (!c || area.isEmpty())
+        return;
+
+    auto left   = getCoverageIndex(area.getX());
+    auto top    = getCoverageIndex(area.getY());
+    auto right  = getCoverageIndex(area.getRight());
+    auto bottom = getCoverageIndex(area.getBottom());
+
+    auto numCells = ((juce::int64)right - left + 1) * ((juce::int64)bottom - top + 1);
+
+    // A large area is checked against the cells that have elements in them
+    // rather than against every cell it overlaps
+    juce::Array<juce::int64> cells;
+
+    if (numCells > c->cells.size())
+    {
+        for (juce::HashMap<juce::int64, juce::Array<CoveredElement>>::Iterator i(c->cells); i.next();)
+            cells.add(i.getKey());
+    }
+    else
+    {
+        for (int row = top; row <= bottom; ++row)
+            for (int column = left; column <= right; ++column)
+                if (c->cells.contains(getCoverageCell(column, row)))
+                    cells.add(getCoverageCell(column, row));
+    }
+
+    for (auto cell : cells)
+    {
+        auto &elements = c->cells.getReference(cell);
+        removeCoveredElements(elements, area, container);
+
+        if (elements.isEmpty())
+            c->cells.remove(cell);
+    }
+}
+
+void LowLevelGraphicsSVGRenderer::removeCoveredElements(
+    juce::Array<CoveredElement> &elements,
+    const juce::Rectangle<float> &area,
+    SVGNode *container)
+{
+    for (int i = elements.size(); --i >= 0;)
+    {
+        auto &covered = elements.getReference(i);
+
+        if (area.contains(covered.bounds))
+        {
+            if (covered.indexEntry >= 0)
+                indexEntries.getReference(covered.indexEntry).element = nullptr;
+
+            if (container == document)
+            {
+                unfinishedChildren.removeFirstMatchingValue(covered.element);
+                finishedChildren.removeFirstMatchingValue(covered.element);
+            }
+
+            container->removeChildElement(covered.element, true);
+            elements.remove(i);
+        }
+    }
+}
+
+int LowLevelGraphicsSVGRenderer::getCoverageIndex(float position)
+{
+    // Kept well inside the range of an int, whatever was drawn
+    return (int)juce::jlimit(-1.0e9f, 1.0e9f, std::floor(position / coverageCellSize));
+}
+
+juce::int64 LowLevelGraphicsSVGRenderer::getCoverageCell(int column, int row)
+{
+    return ((juce::int64)row << 32) ^ (juce::int64)(juce::uint32)column;
+}
+
+void LowLevelGraphicsSVGRenderer::pruneCoverage()
+{
+    // Containers that no saved state draws into can't have anything drawn
+    // over their elements any more
+    for (int i = coverage.size(); --i >= 0;)
+    {
+        auto container = coverage.getUnchecked(i)->container;
+        auto isLive = container == document;
+
+        for (auto s : stateStack)
+            isLive = isLive || s->clipGroup == container;
+
+        if (!isLive)
+        {
+            coverageByContainer.remove(container);
+            coverage.remove(i);
+        }
+    }
+}
+
+void LowLevelGraphicsSVGRenderer::clearCoverage()
+{
+    coverageByContainer.clear();
+    coverage.clear();
+}
+
+SVGNode* LowLevelGraphicsSVGRenderer::createDef(
+    const juce::String &tagName,
+    const juce::String &idPrefix)
+{
+    SVGNode *e;
 
-        case juce::Graphics::highResamplingQuality:
-            return "optimizeQuality";
+    if (snapshotCache && !openGroups.isEmpty())
+    {
+        // Each group keeps its own defs so that its serialized text can be
+        // reused on its own by the next snapshot
+        auto &group = openGroups.getReference(openGroups.size() - 1);
+
+        if (!group.defs)
+        {
+            group.defs = nodes.createElement("defs");
+            group.element->prependChildElement(group.defs);
+        }
+
+        e = group.defs->createNewChildElement(tagName);
+        e->setAttribute(
+            SVGIds::id,
+            group.getIDPrefix() + idPrefix
+                + (contentAddressedIDs ? juce::String() : juce::String(group.numDefs++))
+        );
+    }
+    else
+    {
+        auto defs = document->getChildByName("defs");
+        jassert(defs);
+
+        e = defs->createNewChildElement(tagName);
+        e->setAttribute(
+            SVGIds::id,
+            idPrefix + (contentAddressedIDs ? juce::String() : juce::String(numDefs++))
+        );
+
+        if (memoryBudget > 0)
+            unfinishedChildren.add(e);
+    }
+
+   #if JUCE_VECTOR_ENABLE_INSTRUMENTATION
+    ++stats.defsCreated;
+
+    if (currentOperation)
+        currentOperation->elements.add(e);
+   #endif
+
+    return e;
+}
+
+juce::String LowLevelGraphicsSVGRenderer::finishDef(SVGNode *def)
+{
+    if (!contentAddressedIDs)
+        return "#" + def->getStringAttribute(SVGIds::id);
+
+    OpHash hash;
+    hashDefContent(*def, hash, true);
+
+    auto prefix = def->getStringAttribute(SVGIds::id) + "-";
+    auto digits = juce::String::toHexString((juce::int64)hash.value).paddedLeft('0', 16);
+    auto id     = prefix + digits.substring(0, 12);
+
+    // Images are shared with other documents through the library, and only
+    // the first document to draw one encodes it
+    if (defsLibrary && def->hasTagName("image"))
+    {
+        def->setAttribute(SVGIds::id, id);
+
+        if (defsLibrary->contains(id))
+        {
+            resolvePendingImage(def, false);
+            nodes.release(detachDef(def));
+            noteDefReused();
+        }
+        else
+        {
+            resolvePendingImage(def, true);
+            auto detached = detachDef(def);
+
+            defsLibrary->add(detached->createXmlElement());
+            nodes.release(detached);
+        }
+
+        return defsLibrary->getURL() + "#" + id;
+    }
+
+    // IDs are only shared by identical definitions: when the ID is taken by
+    // different content (or by a definition that has since left memory) it's
+    // extended with the rest of the hash, and then numbered
+    for (int attempt = 0;; ++attempt)
+    {
+        if (!contentDefs.contains(id))
+            break;
+
+        auto existing = contentDefs[id];
+        def->setAttribute(SVGIds::id, id);
+
+        // A definition with the same content already exists, so the new one
+        // is dropped in favour of it
+        if (existing && existing->isEquivalentTo(def, false))
+        {
+            resolvePendingImage(def, false);
+
+           #if JUCE_VECTOR_ENABLE_INSTRUMENTATION
+            --stats.defsCreated;
+           #endif
+
+            nodes.release(detachDef(def));
+            noteDefReused();
+
+            return "#" + id;
+        }
+
+        id = prefix + digits + (attempt == 0 ? juce::String() : "-" + juce::String(attempt));
+    }
+
+    contentDefs.set(id, def);
+    def->setAttribute(SVGIds::id, id);
+
+    return "#" + id;
+}
+
+void LowLevelGraphicsSVGRenderer::forgetContentDefs(const SVGNode &e)
+{
+    if (!contentAddressedIDs || e.isTextElement())
+        return;
+
+    auto id = e.getStringAttribute(SVGIds::id);
+
+    // The ID stays taken, but can no longer be checked against
+    if (contentDefs.contains(id) && contentDefs[id] == &e)
+        contentDefs.set(id, nullptr);
+
+    // Groups reused from a snapshot can hold the defs of the groups that were
+    // drawn inside them
+    for (auto child = e.getFirstChildElement(); child; child = child->getNextElement())
+        forgetContentDefs(*child);
+}
+
+SVGNode* LowLevelGraphicsSVGRenderer::detachDef(SVGNode *def)
+{
+    auto defs = (snapshotCache && !openGroups.isEmpty())
+        ? openGroups.getLast().defs
+        : document->getChildByName("defs");
+
+    unfinishedChildren.removeFirstMatchingValue(def);
+
+   #if JUCE_VECTOR_ENABLE_INSTRUMENTATION
+    for (auto *operation = currentOperation; operation; operation = operation->previous)
+        operation->elements.removeFirstMatchingValue(def);
+   #endif
+
+    defs->removeChildElement(def, false);
+    return def;
+}
+
+void LowLevelGraphicsSVGRenderer::resolvePendingImage(
+    SVGNode *def,
+    bool shouldEncode)
+{
+    for (int i = pendingImages.size(); --i >= 0;)
+    {
+        auto &pending = pendingImages.getReference(i);
+
+        if (pending.element == def)
+        {
+            if (shouldEncode)
+                encodeImageData(pending.element, pending.image, pending.isMask);
+
+            pendingImages.remove(i);
+        }
+    }
+}
+
+void LowLevelGraphicsSVGRenderer::hashDefContent(
+    const SVGNode &e,
+    OpHash &hash,
+    bool isDef)
+{
+    if (e.isTextElement())
+    {
+        hash.add(juce::String(e.getText()));
+        return;
     }
+
+    hash.add(e.getTagName());
+
+    for (int i = 0; i < e.getNumAttributes(); ++i)
+    {
+        // The definition's own ID is what's being worked out
+        if (isDef && e.getAttributeName(i) == SVGIds::id)
+            continue;
+
+        hash.add(e.getAttributeName(i).toString());
+        hash.add(juce::String(e.getAttributeValue(i)));
+    }
+
+    hash.add(e.getNumChildElements());
+
+    for (auto child = e.getFirstChildElement(); child; child = child->getNextElement())
+        hashDefContent(*child, hash, false);
 }
 
-void LowLevelGraphicsSVGRenderer::applyTags(juce::XmlElement *e)
+void LowLevelGraphicsSVGRenderer::noteDefReused()
+{
+   #if JUCE_VECTOR_ENABLE_INSTRUMENTATION
+    ++stats.defsReused;
+   #endif
+}
+
+void LowLevelGraphicsSVGRenderer::applyTags(SVGNode *e)
 {
     if (state->tags.size() == 0)
         return;
@@ -944,77 +3656,446 @@ void LowLevelGraphicsSVGRenderer::applyTags(juce::XmlElement *e)
         e->setAttribute(keys[i], values[i]);
 }
 
+void LowLevelGraphicsSVGRenderer::applyImageData(
+    SVGNode *e,
+    const juce::Image &i,
+    bool isMask)
+{
+    // Encoding is the most expensive part of drawing an image, so it's put off
+    // until the document is known not to be cached, or until the image is
+    // known not to be in the defs library. Reused snapshot groups delete
+    // their elements, so images only wait for the library (which is checked
+    // as soon as they're finished) alongside them.
+    if (defsLibrary || (resultCache && !snapshotCache))
+    {
+        // The placeholder stands in for the data when content addressed IDs
+        // are worked out, so it has to identify the image
+        e->setAttribute(
+            SVGIds::xlinkHref,
+            "data:;juce-vector-pending,"
+                + juce::String::toHexString((juce::int64)hashImage(i))
+                + (isMask ? "m" : "")
+        );
+
+        // The caller could go on to change the image's pixels
+        pendingImages.add({ e, i.createCopy(), isMask });
+        return;
+    }
+
+    encodeImageData(e, i, isMask);
+}
+
+void LowLevelGraphicsSVGRenderer::encodeImageData(
+    SVGNode *e,
+    const juce::Image &i,
+    bool isMask)
+{
+    auto codec = codecPolicy->getCodecForImage(i, isMask);
+    juce::uint64 cacheKey = 0;
+
+    if (encodedImageCache)
+    {
+        // Renderers sharing the cache can have different policies, so the key
+        // covers the codec and quality that were picked as well as the pixels
+        OpHash key;
+        key.add(hashImage(i));
+        key.add(i.getWidth());
+        key.add(i.getHeight());
+        key.add((int)isMask);
+        key.add((int)codec);
+        key.add(codec == ImageCodec::jpeg ? codecPolicy->getJPEGQuality() : 0.0f);
+
+        cacheKey = key.value;
+
+        EncodedImage cached;
+
+        if (encodedImageCache->get(cacheKey, cached))
+        {
+            e->setAttribute(SVGIds::dataCodec, cached.codec);
+            e->setAttribute(SVGIds::xlinkHref, cached.href);
+            return;
+        }
+    }
+
+    juce::MemoryOutputStream out;
+    juce::String mimeType;
+
+    switch (codec)
+    {
+        case ImageCodec::jpeg:
+        {
+            juce::JPEGImageFormat jpeg;
+            jpeg.setQuality(codecPolicy->getJPEGQuality());
+            jpeg.writeImageToStream(isMask ? createLuminanceMask(i) : i, out);
+
+            mimeType = "image/jpeg";
+            e->setAttribute(SVGIds::dataCodec, "jpeg");
+            break;
+        }
+
+        case ImageCodec::singleChannelPNG:
+        {
+            auto alpha = SVGKernels::getAlphaPlane(i);
+
+            SVGKernels::writeGreyscalePNG(
+                static_cast<const juce::uint8*>(alpha.getData()),
+                i.getWidth(),
+                i.getHeight(),
+                out
+            );
+
+            mimeType = "image/png";
+            e->setAttribute(SVGIds::dataCodec, "png-single-channel");
+            break;
+        }
+
+        case ImageCodec::png:
+        {
+            juce::PNGImageFormat png;
+            png.writeImageToStream(isMask ? createLuminanceMask(i) : i, out);
+
+            mimeType = "image/png";
+            e->setAttribute(SVGIds::dataCodec, "png");
+            break;
+        }
+    }
+
+    auto base64Data = juce::Base64::toBase64(out.getData(), out.getDataSize());
+    auto href = "data:" + mimeType + ";base64," + base64Data;
+
+    e->setAttribute(SVGIds::xlinkHref, href);
+
+    if (encodedImageCache)
+    {
+        encodedImageCache->set(
+            cacheKey,
+            { e->getStringAttribute(SVGIds::dataCodec), href },
+            (size_t)href.getNumBytesAsUTF8()
+        );
+    }
+}
+
+juce::uint64 LowLevelGraphicsSVGRenderer::hashBytes(
+    const void *data,
+    size_t numBytes,
+    juce::uint64 seed)
+{
+    // 64-bit FNV-1a
+    auto bytes = static_cast<const juce::uint8*>(data);
+    auto hash  = seed ^ 0xcbf29ce484222325ULL;
+
+    for (size_t i = 0; i < numBytes; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+juce::uint64 LowLevelGraphicsSVGRenderer::hashImage(const juce::Image &i)
+{
+    const int header[] = { i.getWidth(), i.getHeight(), (int)i.getFormat() };
+    auto hash = hashBytes(header, sizeof(header), 0);
+
+    const juce::Image::BitmapData bitmap(i, 0, 0, i.getWidth(), i.getHeight());
+    auto rowBytes = (size_t)(bitmap.width * bitmap.pixelStride);
+
+    for (int y = 0; y < bitmap.height; ++y)
+        hash = hashBytes(bitmap.getLinePointer(y), rowBytes, hash);
+
+    return hash;
+}
+
+juce::Image LowLevelGraphicsSVGRenderer::createLuminanceMask(
+    const juce::Image &i)
+{
+    // SVG masks use luminance, so the alpha channel is written out as an
+    // opaque grey image
+    juce::Image mask(juce::Image::RGB, i.getWidth(), i.getHeight(), false);
+
+    auto alpha = SVGKernels::getAlphaPlane(i);
+    auto level = static_cast<const juce::uint8*>(alpha.getData());
+
+    const juce::Image::BitmapData bitmap(mask, juce::Image::BitmapData::writeOnly);
+
+    for (int y = 0; y < bitmap.height; ++y)
+    {
+        auto pixel = bitmap.getLinePointer(y);
+
+        for (int x = 0; x < bitmap.width; ++x, pixel += bitmap.pixelStride, ++level)
+            pixel[0] = pixel[1] = pixel[2] = *level;
+    }
+
+    return mask;
+}
+
+juce::int64 LowLevelGraphicsSVGRenderer::estimateSize(const SVGNode &e)
+{
+    auto numBytes = [](juce::StringRef s)
+    {
+        return (juce::int64)std::strlen(s.text.getAddress());
+    };
+
+    if (e.isTextElement())
+        return numBytes(e.getText());
+
+    // <tag></tag>
+    auto size = (juce::int64)e.getTagName().getNumBytesAsUTF8() * 2 + 5;
+
+    // name="value"
+    for (int i = 0; i < e.getNumAttributes(); ++i)
+        size += numBytes(e.getAttributeName(i)) + numBytes(e.getAttributeValue(i)) + 4;
+
+    for (auto child = e.getFirstChildElement(); child; child = child->getNextElement())
+        size += estimateSize(*child);
+
+    return size;
+}
+
 #pragma mark -
 // =============================================================================
 
 void LowLevelGraphicsSVGRenderer::applyTextPos(
-    juce::XmlElement *text,
+    SVGNode *text,
     int x, int y,
     const int width, const int height,
-    const juce::Justification &j)
+    const juce::Justification &j,
+    const juce::AffineTransform &bake)
 {
     if (j.testFlags(j.horizontallyCentred))
     {
-        text->setAttribute("text-anchor", "middle");
+        text->setAttribute(SVGIds::textAnchor, "middle");
         x += width / 2;
     }
     else if (j.testFlags(j.right))
     {
-        text->setAttribute("text-anchor", "end");
+        text->setAttribute(SVGIds::textAnchor, "end");
         x += width;
     }
     else
     {
-        text->setAttribute("text-anchor", "start");
+        text->setAttribute(SVGIds::textAnchor, "start");
     }
 
     if (j.testFlags(j.verticallyCentred))
     {
-        text->setAttribute("dominant-baseline", "central");
+        text->setAttribute(SVGIds::dominantBaseline, "central");
         y += height / 2;
     }
     else if (j.testFlags(j.bottom))
     {
-        text->setAttribute("dominant-baseline", "ideographic");
+        text->setAttribute(SVGIds::dominantBaseline, "ideographic");
         y += height;
     }
     else
     {
-        text->setAttribute("dominant-baseline", "hanging");
+        text->setAttribute(SVGIds::dominantBaseline, "hanging");
+    }
+
+    writeTextPosition(text, (float)x, (float)y, bake);
+}
+
+juce::AffineTransform LowLevelGraphicsSVGRenderer::applyTextTransform(
+    SVGNode *text)
+{
+    // A translation or uniform scale is baked into the text's positions and
+    // font size. Anything else (including a flip) is written out as-is.
+    if (isUniformScale(state->transform) && state->transform.mat00 > 0.0f)
+        return state->transform;
+
+    text->setAttribute(SVGIds::transform, writeTransform(state->transform));
+    return {};
+}
+
+void LowLevelGraphicsSVGRenderer::writeTextPosition(
+    SVGNode *text,
+    float x,
+    float y,
+    const juce::AffineTransform &bake) const
+{
+    bake.transformPoint(x, y);
+
+    text->setAttribute(SVGIds::x, writeCoordinate(x));
+    text->setAttribute(SVGIds::y, writeCoordinate(y));
+}
+
+bool LowLevelGraphicsSVGRenderer::isCulled() const
+{
+    return state->clipIsRectangles && state->clipRegions.isEmpty();
+}
+
+juce::Rectangle<float> LowLevelGraphicsSVGRenderer::getClipBoundsInternal() const
+{
+    if (state->clipIsRectangles)
+        return state->clipRegions.getBounds().toFloat();
+
+    return state->clipBounds;
+}
+
+void LowLevelGraphicsSVGRenderer::switchToRectangleClip()
+{
+    // Only the bounds of a path clip are known, but they still limit the
+    // rectangles that can be drawn into
+    if (!state->clipIsRectangles)
+    {
+        state->clipRegions = state->clipBounds.getSmallestIntegerContainer();
+        state->clipIsRectangles = true;
+    }
+}
+
+void LowLevelGraphicsSVGRenderer::switchToPathClip(
+    const juce::Path &path,
+    juce::Rectangle<float> bounds)
+{
+    state->clipPath   = path;
+    state->clipBounds = bounds;
+    state->clipIsRectangles = false;
+
+    // The rectangle list is kept in the same space as the path, so that
+    // rectangles clipped into it later don't mix the two
+    state->clipRegions = bounds.getSmallestIntegerContainer();
+}
+
+bool LowLevelGraphicsSVGRenderer::isRectangle(
+    const juce::Path &p,
+    juce::Rectangle<float> &rect)
+{
+    juce::Array<juce::Point<float>> corners;
+    juce::Path::Iterator i(p);
+
+    while (i.next())
+    {
+        switch (i.elementType)
+        {
+            case juce::Path::Iterator::startNewSubPath:
+                if (corners.size() > 0)
+                    return false;
+
+                corners.add({ i.x1, i.y1 });
+                break;
+
+            case juce::Path::Iterator::lineTo:
+                if (juce::Point<float>(i.x1, i.y1) != corners.getLast())
+                    corners.add({ i.x1, i.y1 });
+
+                break;
+
+            case juce::Path::Iterator::closePath:
+                break;
+
+            default:
+                return false;
+        }
+    }
+
+    if (corners.size() == 5 && corners.getLast() == corners.getFirst())
+        corners.removeLast();
+
+    if (corners.size() != 4)
+        return false;
+
+    // Every edge has to be horizontal or vertical
+    for (int c = 0; c < 4; ++c)
+    {
+        auto a = corners.getReference(c);
+        auto b = corners.getReference((c + 1) % 4);
+
+        if (a.x != b.x && a.y != b.y)
+            return false;
     }
 
-    text->setAttribute("x", x);
-    text->setAttribute("y", y);
+    rect = p.getBounds();
+    return true;
 }
 
 void LowLevelGraphicsSVGRenderer::setClip(const juce::Path &p)
 {
-    state->clipPath = p;
+    switchToPathClip(p, p.getBounds());
+    setClip();
+}
+
+void LowLevelGraphicsSVGRenderer::setClip()
+{
+    JUCE_VECTOR_INSTRUMENT(setClip)
 
-    auto defs = document->getChildByName("defs");
-    auto clipRef = juce::String::formatted(
-        "#ClipPath%d",
-        defs->getNumChildElements()
-    );
+    // Nothing will be drawn into an empty clip, so it doesn't need a group
+    if (isCulled())
+        return;
 
-    auto clipPath = defs->createNewChildElement("clipPath");
-    clipPath->setAttribute("id", clipRef.replace("#", ""));
+    auto clipPath = createDef("clipPath", "ClipPath");
 
-    auto path = clipPath->createNewChildElement("path");
-    path->setAttribute("d", state->clipPath.toString().toUpperCase());
+    juce::Array<SVGNode*> shapes;
+
+    if (state->clipIsRectangles)
+    {
+        // A clipPath clips to the union of its children, so rectangle clips
+        // don't need to be turned into path data
+        for (auto &r : state->clipRegions)
+        {
+            auto rect = clipPath->createNewChildElement("rect");
+
+            rect->setAttribute(SVGIds::x, r.getX());
+            rect->setAttribute(SVGIds::y, r.getY());
+            rect->setAttribute(SVGIds::width,  r.getWidth());
+            rect->setAttribute(SVGIds::height, r.getHeight());
+
+            shapes.add(rect);
+        }
+    }
+    else
+    {
+        auto path = clipPath->createNewChildElement("path");
+        path->setAttribute(SVGIds::d, writePath(state->clipPath, juce::AffineTransform()));
+
+        shapes.add(path);
+    }
 
     if (!state->transform.isIdentity())
-        path->setAttribute(
-            "transform",
-            writeTransform(
-                state->transform
-            )
-        );
+    {
+        auto transform = writeTransform(state->transform);
+
+        for (auto shape : shapes)
+            shape->setAttribute(SVGIds::transform, transform);
+    }
+
+    auto clipRef = finishDef(clipPath);
 
     if (!state->clipGroup)
-        state->clipGroup = document->createNewChildElement("g");
+        openClipGroup();
+
+    openClipGroup();
+
+    state->clipGroup->setAttribute(SVGIds::clipPath, "url(" + clipRef + ")");
+}
+
+void LowLevelGraphicsSVGRenderer::openClipGroup()
+{
+    auto parent = state->clipGroup ? state->clipGroup : document;
+    state->clipGroup = parent->createNewChildElement("g");
+
+   #if JUCE_VECTOR_ENABLE_INSTRUMENTATION
+    if (currentOperation)
+        currentOperation->elements.add(state->clipGroup);
+   #endif
 
-    state->clipGroup = state->clipGroup->createNewChildElement("g");
+    if (parent == document)
+        state->topLevelGroup = state->clipGroup;
+
+    pruneCoverage();
+}
+
+bool LowLevelGraphicsSVGRenderer::hasDrawnContent(const SVGNode &e)
+{
+    for (auto child = e.getFirstChildElement(); child; child = child->getNextElement())
+    {
+        // Groups only draw what's in them, and defs draw nothing by themselves
+        if (child->hasTagName("defs"))
+            continue;
+
+        if (!child->hasTagName("g") || hasDrawnContent(*child))
+            return true;
+    }
 
-    state->clipGroup->setAttribute("clip-path", "url(" + clipRef + ")");
+    return false;
 }
@@ -31,15 +31,106 @@
 class LowLevelGraphicsSVGRenderer : public juce::LowLevelGraphicsContext
 {
 public:
+    /** The formats that embedded images can be encoded as.
+    */
+    enum class ImageCodec
+    {
+        png,
+        jpeg,
+        singleChannelPNG
+    };
+
+    /** Decides how each embedded image is encoded.
+
+        Subclass this and pass it to setImageCodecPolicy() to control which
+        codec is used for each image.
+    */
+    class ImageCodecPolicy
+    {
+    public:
+        virtual ~ImageCodecPolicy() {}
+
+        /** Returns the codec to use for an image.
+
+            @param image  the image that is about to be encoded
+            @param isMask true if the image was passed to clipToImageAlpha()
+        */
+        virtual ImageCodec getCodecForImage(const juce::Image&, bool isMask) = 0;
+
+        /** Returns the quality (0 to 1) to use for images encoded as JPEG.
+        */
+        virtual float getJPEGQuality() { return 0.85f; }
+    };
+
+    /** The policy used unless another one is set.
+
+        Masks are encoded as single channel PNGs. Images with any transparency
+        or with only a few distinct colours (icons, flat UI artwork) are
+        encoded as PNG, and opaque images with many colours (photographic
+        content) are encoded as JPEG.
+
+        Colours are counted on a sparse grid of sample points rather than over
+        the whole image, so the decision stays cheap for large images.
+    */
+    class DefaultImageCodecPolicy : public ImageCodecPolicy
+    {
+    public:
+        /** Creates a policy.
+
+            @param jpegQuality      the quality to encode JPEG images at
+            @param maxPNGColours    opaque images with more distinct sampled
+                                    colours than this are encoded as JPEG
+        */
+        DefaultImageCodecPolicy(float jpegQuality = 0.85f, int maxPNGColours = 64);
+
+        ImageCodec getCodecForImage(const juce::Image&, bool isMask) override;
+        float getJPEGQuality() override;
+
+    private:
+        float quality;
+        int maxColours;
+    };
+
+    /** The encoded data of an embedded image.
+    */
+    struct EncodedImage
+    {
+        juce::String codec;     // as written to the data-codec attribute
+        juce::String href;      // the data: URI
+    };
+
+    /** A cache of encoded images that renderers on any number of threads can
+        share (see setEncodedImageCache()).
+    */
+    using EncodedImageCache = SVGSharedCache<EncodedImage>;
+
+    #pragma mark -
+    // =========================================================================
+
     /** Creates a new SVG renderer.
 
-        @param svgD
+        The document is built from pooled nodes (see SVGNode) while drawing,
+        and copied into the juce::XmlElement when the renderer is deleted.
+
+        @param svgDocument  an empty <svg> element to fill in, or nullptr if
+                            the document will only be written with
+                            writeSnapshot() or copied with createDocument()
     */
     LowLevelGraphicsSVGRenderer(
         juce::XmlElement *svgDocument,
         int totalWidth, int totalHeight
     );
 
+    /** Creates a new SVG renderer that doesn't fill in a juce::XmlElement.
+    */
+    LowLevelGraphicsSVGRenderer(int totalWidth, int totalHeight);
+
+    ~LowLevelGraphicsSVGRenderer();
+
+    /** Copies the document drawn so far into an empty <svg> element.
+    */
+    void createDocument(juce::XmlElement *svgDocument) const;
+
     #pragma mark -
     // =========================================================================
 
@@ -81,14 +172,19 @@ public:
     */
     void excludeClipRectangle(const juce::Rectangle<int>&) override;
 
-    /** Sets the clip region to a given path.
+    /** Intersects the current clipping region with a path.
 
-        NOTE: This currently will not intersect current regions unlike the
-        rectangle clipping does.
+        Paths that don't overlap the current clip empty it, which stops
+        anything else being drawn, and rectangles that cover it are ignored.
+        Any other path is written as a nested clip group.
     */
     void clipToPath(const juce::Path&, const juce::AffineTransform&) override;
 
     /** Applies an image mask to subsequent elements.
+
+        Only the image's alpha channel is embedded. Masks made from the same
+        image content share a single embedded image, and identical masks share
+        a single <mask> element.
     */
     void clipToImageAlpha(const juce::Image&, const juce::AffineTransform&) override;
 
@@ -119,13 +215,16 @@ public:
     #pragma mark -
     // =========================================================================
 
-    /** Applies an opacity value to the current juce::FillType.
+    /** Saves the current graphics state and opens a group that everything
+        drawn until endTransparencyLayer() is placed in.
 
-        When an opacity is applied it will export as the attribute fill-opacity.
+        The opacity is written on the group (<g opacity="...">), so viewers
+        composite the layer as a whole rather than each element on its own.
     */
     void beginTransparencyLayer(float) override;
 
-    /** Resets the opacity of the current juce::FillType.
+    /** Closes the current transparency layer and restores the graphics state
+        from before it began.
     */
     void endTransparencyLayer() override;
 
@@ -377,40 +476,568 @@ public:
     */
     void clearTags();
 
+    #pragma mark -
+    // =========================================================================
+
+    /** Enables resolution-aware downsampling of embedded images.
+
+        When enabled, drawImage() works out how many output pixels an image
+        will cover (from the context's transform and the transform passed to
+        drawImage()) and resamples the image to that size, multiplied by the
+        oversampling factor, before it is encoded. Images are never upscaled.
+
+        Downsampling is disabled by default.
+
+        @param shouldDownsample whether images should be resampled
+        @param oversampling     the number of image pixels to keep for every
+                                output pixel (e.g. 2.0 for high-DPI displays)
+    */
+    void setImageDownsampling(bool shouldDownsample, float oversampling = 1.0f);
+
+    /** Sets the policy that picks the codec for each embedded image.
+
+        Each embedded image records the codec that was chosen for it in a
+        data-codec attribute.
+
+        The renderer takes ownership of the policy. Passing nullptr restores a
+        DefaultImageCodecPolicy.
+    */
+    void setImageCodecPolicy(ImageCodecPolicy*);
+
+    /** Shares encoded images with other renderers.
+
+        Before an image is encoded it's looked up in the cache by its content
+        and the codec that the ImageCodecPolicy picks for it, and images that
+        have to be encoded are added to the cache. Lookups don't take a lock,
+        so one cache can serve every renderer in a process, whichever threads
+        they run on. The cache is not owned by the renderer.
+    */
+    void setEncodedImageCache(EncodedImageCache*);
+
+    /** Enables simplification of filled paths.
+
+        When enabled, fillPath() drops vertices and merges segments that can't
+        be told apart at the output size, and fits smooth runs of line segments
+        back into curves. This keeps densely sampled paths (such as waveforms)
+        small when exporting thumbnails.
+
+        The tolerance is measured in output pixels, so it's scaled to account
+        for the context's current transform. Simplification is disabled by
+        default.
+
+        @param toleranceInPixels the largest distance the simplified outline
+                                 may be from the original, or 0 to disable
+    */
+    void setPathSimplification(float toleranceInPixels);
+
+    #pragma mark -
+    // =========================================================================
+
+    /** Decides how many decimal places coordinates are written with.
+
+        Positions, lengths and path data use the policy directly. Scale
+        factors in transforms get two more places, as their errors are
+        multiplied by the coordinates they're applied to.
+    */
+    struct PrecisionPolicy
+    {
+        enum class Mode
+        {
+            decimalPlaces,
+            significantDigits,
+            automatic
+        };
+
+        /** Writes coordinates with up to a fixed number of decimal places.
+            This is the default, with 2 places.
+        */
+        static PrecisionPolicy decimalPlaces(int);
+
+        /** Writes coordinates with up to a number of significant digits, so
+            small values keep their detail and large ones don't carry decimals
+            they don't need.
+        */
+        static PrecisionPolicy significantDigits(int);
+
+        /** Uses the fewest decimal places that keep rounding errors under a
+            number of output pixels at the context's current scale, and never
+            more than a float can hold for positions on the canvas.
+        */
+        static PrecisionPolicy automatic(float maxErrorInPixels = 0.05f);
+
+        /** Returns the number of decimal places to write a value with, for a
+            canvas of the given size drawn at the given scale.
+        */
+        int getDecimalPlaces(float value, float canvasSize, float scale) const;
+
+        Mode mode      = Mode::decimalPlaces;
+        int digits     = 2;
+        float maxError = 0.05f;
+
+        static constexpr int maxDecimalPlaces = 6;
+    };
+
+    /** Sets the precision coordinates are written with.
+    */
+    void setPrecisionPolicy(const PrecisionPolicy&);
+
+    /** Returns the precision coordinates are written with.
+    */
+    const PrecisionPolicy& getPrecisionPolicy() const;
+
+    #pragma mark -
+    // =========================================================================
+
+    /** Counters and timers collected for each drawing operation.
+
+        Statistics are only collected when the module is built with
+        JUCE_VECTOR_ENABLE_INSTRUMENTATION enabled. Otherwise every counter
+        stays at zero and the renderer does no extra work.
+
+        Times are inclusive of any operations that an operation issues itself
+        (e.g. drawGlyph() includes the fillPath() it uses), whereas elements
+        and bytes are attributed to the operation that created them.
+    */
+    struct Stats
+    {
+        enum Operation
+        {
+            setOrigin,
+            addTransform,
+            clipToRectangle,
+            clipToRectangleList,
+            excludeClipRectangle,
+            clipToPath,
+            clipToImageAlpha,
+            clipRegionIntersects,
+            getClipBounds,
+            isClipEmpty,
+            setClip,
+            saveState,
+            restoreState,
+            beginTransparencyLayer,
+            endTransparencyLayer,
+            setFill,
+            setOpacity,
+            setInterpolationQuality,
+            fillRect,
+            fillRectList,
+            fillPath,
+            drawImage,
+            drawLine,
+            setFont,
+            getFont,
+            drawGlyph,
+            drawSingleLineText,
+            drawMultiLineText,
+            drawText,
+            drawFittedText,
+            pushGroup,
+            popGroup,
+            setTags,
+            clearTags,
+
+            numOperations
+        };
+
+        struct Counter
+        {
+            juce::int64 calls    = 0;
+            juce::int64 elements = 0;   // elements created, including defs
+            juce::int64 bytes    = 0;   // approximate serialized size
+            juce::int64 ticks    = 0;   // high resolution ticks
+
+            double getSeconds() const;
+        };
+
+        struct Event
+        {
+            Operation operation;
+            juce::int64 startTicks;
+            juce::int64 durationTicks;
+        };
+
+        Counter operations[numOperations];
+
+        juce::int64 defsCreated = 0;
+        juce::int64 defsReused  = 0;
+
+        /** The most memory the renderer's scratch arena has had in use at
+            once, and the memory it holds on to for reuse. These are kept
+            whether or not instrumentation is enabled.
+        */
+        juce::int64 scratchHighWaterMark = 0;
+        juce::int64 scratchBytesReserved = 0;
+
+        /** The memory the document's nodes, attributes and text are using,
+            the most they have used at once, and the memory their pool holds
+            on to. These are kept whether or not instrumentation is enabled.
+        */
+        juce::int64 documentBytesInUse    = 0;
+        juce::int64 documentHighWaterMark = 0;
+        juce::int64 documentBytesReserved = 0;
+
+        /** Individual calls, in the order they finished, up to the limit set
+            with setMaxTraceEvents().
+        */
+        juce::Array<Event> events;
+
+        /** Returns the name of an operation (e.g. "fillPath").
+        */
+        static juce::String getOperationName(Operation);
+
+        /** Writes the statistics in the Chrome trace-event format, which can
+            be loaded by chrome://tracing and similar viewers.
+
+            Each recorded call becomes a complete ("X") event, and the totals
+            for each operation become counter ("C") events.
+        */
+        juce::String toChromeTraceJSON() const;
+    };
+
+    /** Returns the statistics collected so far.
+    */
+    const Stats& getStats() const;
+
+    /** Clears the statistics collected so far.
+    */
+    void resetStats();
+
+    /** Sets the maximum number of individual calls kept in Stats::events.
+
+        Counters keep accumulating after the limit is reached. Defaults to
+        100000.
+    */
+    void setMaxTraceEvents(int);
+
+    #pragma mark -
+    // =========================================================================
+
+    /** Keeps the serialized groups of a snapshot so that the next snapshot of
+        the same UI can reuse the groups that haven't changed.
+
+        The cache outlives the renderers that use it: create one, and hand it
+        to a new renderer for every snapshot with setSnapshotCache().
+    */
+    class SnapshotCache
+    {
+    public:
+        SnapshotCache() {}
+
+        /** Forgets every cached group.
+        */
+        void clear();
+
+        /** Returns the number of groups that the last snapshot written with
+            writeSnapshot() reused from the cache.
+        */
+        int getNumReusedGroups() const;
+
+        /** Returns the number of groups that the last snapshot written with
+            writeSnapshot() had to serialize again.
+        */
+        int getNumRepaintedGroups() const;
+
+    private:
+        friend class LowLevelGraphicsSVGRenderer;
+
+        struct Fragment
+        {
+            juce::uint64 hash = 0;
+            juce::String text;
+            juce::StringArray childKeys;
+        };
+
+        juce::HashMap<juce::String, Fragment> fragments;
+
+        int numReused    = 0;
+        int numRepainted = 0;
+
+        JUCE_DECLARE_NON_COPYABLE(SnapshotCache)
+    };
+
+    /** Enables incremental snapshots.
+
+        Every drawing operation inside a group (see pushGroup()) is hashed
+        along with the state the group started in. When a group is popped and
+        its hash matches the one recorded by the previous snapshot, the
+        elements that were drawn for it are discarded and the previously
+        serialized text is reused when the document is written. Defs created
+        inside a group are kept inside the group so that its text stays
+        self-contained.
+
+        This must be called before anything is drawn, and the document must
+        then be written with writeSnapshot() rather than through the
+        SVGNode. The cache is not owned by the renderer.
+    */
+    void setSnapshotCache(SnapshotCache*);
+
+    /** Writes the document to a stream.
+
+        When a SnapshotCache is in use, unchanged groups are written from the
+        cache and the cache is updated with the groups of this snapshot.
+    */
+    void writeSnapshot(juce::OutputStream&);
+
+    /** Enables IDs derived from the content of each definition.
+
+        By default definitions are numbered in the order they're created, so
+        one extra definition renumbers every one after it. With content
+        addressed IDs each definition's ID is its type followed by a short
+        hash of its content (e.g. "Gradient-3fa2c1d9e0b4"), so identical
+        drawing produces identical documents whatever order it happens in.
+        Definitions that turn out to be identical are also merged.
+
+        This must be called before anything is drawn.
+    */
+    void setContentAddressedIDs(bool);
+
+    /** Enables caching whole documents on disk.
+
+        Every drawing call is hashed along with its arguments as it's made,
+        with images and paths hashed by their content. writeSnapshot() looks
+        the resulting hash up in the cache and copies the cached document when
+        there is one, and otherwise serializes the document and adds it to the
+        cache. Embedded images are only encoded once the document turns out
+        not to be cached, so an unchanged UI costs little more than painting
+        it.
+
+        The hash covers the document's size and the renderer's settings, but
+        not the ImageCodecPolicy: clear the cache when the policy changes.
+
+        This can be combined with a SnapshotCache, which is then only used
+        (and updated) when the document isn't found in the result cache. This
+        must be called before anything is drawn, and the document must then be
+        written with writeSnapshot() rather than through the SVGNode.
+        It can't be combined with a memory budget or spatial indexing. The
+        cache is not owned by the renderer.
+    */
+    void setResultCache(SVGResultCache*);
+
+    /** Returns the hash that writeSnapshot() would look the document up with,
+        or 0 if no result cache is in use.
+    */
+    juce::uint64 getDocumentHash() const;
+
+    /** Moves embedded images into a library shared with other documents.
+
+        Images are added to the library instead of this document's <defs>,
+        and referred to as "<url>#<id>" (see SVGDefsLibrary). Images that are
+        already in the library aren't encoded again. This turns on content
+        addressed IDs, so that the same image has the same ID whichever
+        document draws it.
+
+        This must be called before anything is drawn. The library is not
+        owned by the renderer.
+    */
+    void setDefsLibrary(SVGDefsLibrary*);
+
+    #pragma mark -
+    // =========================================================================
+
+    /** Enables writing finished content to a temporary file.
+
+        Top level groups are finished once they are popped with popGroup(), or
+        once the state that drew into them has been restored with
+        restoreState(). When the finished content that is still in memory
+        grows past the budget, it is written to a temporary file and replaced
+        by a small placeholder, and writeSnapshot() splices it back in. This
+        keeps memory use bounded however large the document gets, provided
+        that content is drawn inside saved states or groups.
+
+        This must be called before anything is drawn, and the document must
+        then be written with writeSnapshot() rather than through the
+        SVGNode. It can't be combined with a SnapshotCache or with
+        spatial indexing.
+
+        @param maxBytes the approximate size of finished content to keep in
+                        memory, or 0 to keep everything in memory
+    */
+    void setMemoryBudget(juce::int64 maxBytes);
+
+    #pragma mark -
+    // =========================================================================
+
+    /** Enables a spatial index over the elements that are drawn.
+
+        While indexing, the bounds of every element are recorded (in document
+        coordinates) in a grid, so that the finished document can be queried
+        by region with getElementsIn(), getElementsAt() and extractRegion()
+        without painting it again. Text elements have no known bounds and are
+        treated as covering the whole document.
+
+        This must be called before anything is drawn, and can't be combined
+        with a SnapshotCache (which discards elements when groups are reused).
+
+        @param shouldIndex whether elements should be indexed
+        @param cellSize    the size of each grid cell, in document units
+    */
+    void setSpatialIndexing(bool shouldIndex, float cellSize = 256.0f);
+
+    /** Returns the indexed elements that overlap an area, in the order they
+        were drawn.
+    */
+    juce::Array<SVGNode*> getElementsIn(const juce::Rectangle<float>&) const;
+
+    /** Returns the indexed elements under a point, topmost first.
+
+        Elements are hit-tested by their bounds, and text is never returned.
+    */
+    juce::Array<SVGNode*> getElementsAt(juce::Point<float>) const;
+
+    /** Copies the elements that overlap an area into a new SVG document.
+
+        The new document covers just the area (using a viewBox), and keeps the
+        groups, clips and defs that the copied elements depend on. Defs that
+        nothing in the area uses are left out, and are never copied.
+
+        @param area          the area to extract, in document coordinates
+        @param svgDocument   an empty <svg> element to copy into
+        @param includeImages if false, <image> defs are left out too, and the
+                             <use> elements that show them still refer to
+                             them by ID (so they can point at another document)
+    */
+    void extractRegion(
+        const juce::Rectangle<float> &area,
+        juce::XmlElement *svgDocument,
+        bool includeImages = true
+    ) const;
+
+    /** Copies every <image> def into an empty <svg> element, so that they can
+        be shared by documents made with extractRegion(area, svg, false).
+    */
+    void extractImages(juce::XmlElement *svgDocument) const;
+
 #pragma mark - 
 // =============================================================================
 private:
-    juce::String truncateFloat(float);
+    static juce::String truncateFloat(float, int maxDecimalPlaces = 2);
 
     juce::String getPreviousGradientRef(juce::ColourGradient*);
 
-    juce::String writeTransform(const juce::AffineTransform&);
+    // Transforms that only translate, or scale along the axes, can usually be
+    // baked into coordinates rather than written as an attribute
+    enum class TransformType
+    {
+        identity,
+        translation,
+        scale,      // axis-aligned, possibly with a translation
+        general
+    };
+
+    static TransformType classifyTransform(const juce::AffineTransform&);
+    static bool isUniformScale(const juce::AffineTransform&);
+
+    int getDecimalPlaces(float value) const;
+    juce::String writeCoordinate(float value, int extraDecimalPlaces = 0) const;
+
+    juce::String writeTransform(const juce::AffineTransform&) const;
+    juce::String writePath(
+        const juce::Path&,
+        const juce::AffineTransform&,
+        juce::Rectangle<float> *bounds = nullptr
+    );
     juce::String writeColour(const juce::Colour&);
+    juce::String writeOpacity(float);
+    void applyOpacity(SVGNode*, const juce::Identifier&, float opacity);
     juce::String writeFill();
     juce::String writeImageQuality();
 
-    void applyTags(juce::XmlElement*);
+    juce::String getImageRef(
+        const juce::Image&,
+        juce::uint64 imageHash,
+        const juce::AffineTransform&
+    );
+
+    juce::String getPatternRef(const juce::FillType&);
+
+    SVGNode* createElement(const juce::String&);
+    void noteElementBounds(SVGNode*, const juce::Rectangle<float>&);
+    static bool isOpaque(const juce::FillType&);
+    void removeCoveredElements(const juce::Rectangle<float>&);
+    SVGNode* createDef(const juce::String&, const juce::String &idPrefix);
+    void noteDefReused();
+
+    void applyTags(SVGNode*);
+    void applyImageData(SVGNode*, const juce::Image&, bool isMask);
+    void encodeImageData(SVGNode*, const juce::Image&, bool isMask);
+
+    static juce::uint64 hashBytes(const void*, size_t, juce::uint64 seed);
+    static juce::uint64 hashImage(const juce::Image&);
+    static juce::Image createLuminanceMask(const juce::Image&);
+    static juce::int64 estimateSize(const SVGNode&);
+    static void writeEscaped(juce::OutputStream&, juce::StringRef, bool isAttribute);
 
     #pragma mark -
     // =========================================================================
 
+    // The shared bodies of the public overloads, which are each instrumented
+    // and hashed as one call
+    void fillRectInternal(const juce::Rectangle<float>&);
+
+    void drawTextInternal(
+        const juce::String&,
+        int x,
+        int y,
+        int width,
+        int height,
+        juce::Justification,
+        bool useEllipsesIfTooBig
+    );
+
+    void drawFittedTextInternal(
+        const juce::String&,
+        int x,
+        int y,
+        int width,
+        int height,
+        juce::Justification,
+        int maximumNumberOfLines,
+        float minimumHorizontalScale
+    );
+
     void applyTextPos(
-        juce::XmlElement*,
+        SVGNode*,
         int x,
         int y,
         const int width,
         const int height,
-        const juce::Justification&
+        const juce::Justification&,
+        const juce::AffineTransform &bake
     );
 
+    // Text takes on a translation or uniform scale through its positions and
+    // font size, and is only given a transform attribute for anything else.
+    // The returned transform is the part to bake in.
+    juce::AffineTransform applyTextTransform(SVGNode*);
+    void writeTextPosition(
+        SVGNode*,
+        float x,
+        float y,
+        const juce::AffineTransform &bake
+    ) const;
+
+    void pushState();
+    void popState();
+
     void setClip(const juce::Path&);
+    void setClip();
+    void openClipGroup();
+    static bool hasDrawnContent(const SVGNode&);
+
+    bool isCulled() const;
+    juce::Rectangle<float> getClipBoundsInternal() const;
+    void switchToRectangleClip();
+    void switchToPathClip(const juce::Path&, juce::Rectangle<float> bounds);
+
+    static bool isRectangle(const juce::Path&, juce::Rectangle<float>&);
 
     #pragma mark -
     // =========================================================================
 
     struct SavedState
     {
-        SavedState() { xOffset = 0; yOffset = 0; };
+        SavedState() { xOffset = 0; yOffset = 0; clipIsRectangles = true; layerGroup = nullptr; };
         SavedState& operator=(const SavedState&) = delete;
         ~SavedState() {};
 
@@ -418,24 +1045,169 @@ private:
         juce::RectangleList<int> clipRegions;
         juce::Path clipPath;
 
-        juce::XmlElement *clipGroup;
+        // Rectangle clips are kept in clipRegions, and clipPath is only used
+        // once the clip can't be described by rectangles. Path clips are
+        // intersected by nesting clip groups, so clipBounds keeps the bounds
+        // of the intersection for clip queries.
+        bool clipIsRectangles;
+        juce::Rectangle<float> clipBounds;
+
+        SVGNode *clipGroup;
+
+        // The child of the document that clipGroup is inside of, if any
+        SVGNode *topLevelGroup;
+
+        // The group opened by the innermost transparency layer, if any
+        SVGNode *layerGroup;
 
         juce::AffineTransform transform;
 
         juce::FillType fillType;
         juce::String gradientRef;
+        juce::String fillURL;       // "url(#...)" for gradient and image fills
 
         juce::Font font;
 
         juce::StringPairArray tags;
     };
 
+   #if JUCE_VECTOR_ENABLE_INSTRUMENTATION
+    struct ScopedOperation
+    {
+        ScopedOperation(const LowLevelGraphicsSVGRenderer&, Stats::Operation);
+        ~ScopedOperation();
+
+        const LowLevelGraphicsSVGRenderer &renderer;
+        ScopedOperation *previous;
+
+        Stats::Operation operation;
+        juce::int64 startTicks;
+
+        juce::Array<SVGNode*> elements;
+    };
+
+    mutable ScopedOperation *currentOperation = nullptr;
+   #endif
+
+    mutable Stats stats;
+    int maxTraceEvents;
+
     struct GradientRef
     {
         juce::ColourGradient gradient;
         juce::String ref;
+        juce::String scope;
+    };
+
+    #pragma mark -
+    // =========================================================================
+
+    struct OpHash
+    {
+        juce::uint64 value = 0;
+        OpHash *next = nullptr;     // also receives everything that's added
+
+        void add(const void*, size_t);
+        void add(int);
+        void add(float);
+        void add(juce::uint64);
+        void add(const juce::String&);
+        void add(const juce::Rectangle<int>&);
+        void add(const juce::Rectangle<float>&);
+        void add(const juce::RectangleList<int>&);
+        void add(const juce::AffineTransform&);
+        void add(const juce::Path&);
+        void add(const juce::FillType&);
+        void add(const juce::Font&);
+        void add(const juce::StringPairArray&);
     };
 
+    struct OpenGroup
+    {
+        juce::String getIDPrefix() const;
+
+        SVGNode *element = nullptr;
+        SVGNode *defs    = nullptr;
+
+        juce::String key;
+        OpHash hash;
+        int numDefs = 0;
+    };
+
+    using FragmentMap = juce::HashMap<juce::String, SnapshotCache::Fragment>;
+
+    OpHash* hashOp(Stats::Operation);
+    void hashState(OpHash&);
+
+    // Gives a definition its final ID once its content is complete, and
+    // returns its "#id" reference
+    juce::String finishDef(SVGNode*);
+
+    // Takes a definition out of the document, leaving the caller to own it
+    SVGNode* detachDef(SVGNode*);
+    void resolvePendingImage(SVGNode*, bool shouldEncode);
+
+    SVGDefsLibrary *defsLibrary = nullptr;
+    static void hashDefContent(const SVGNode&, OpHash&, bool isDef);
+
+    bool contentAddressedIDs;
+    // Each content addressed ID, with the definition that holds it (or
+    // nullptr once that has been spilled or discarded)
+    juce::HashMap<juce::String, SVGNode*> contentDefs;
+
+    void forgetContentDefs(const SVGNode&);
+
+    juce::String getDefScope() const;
+
+    void finishSnapshotGroup(const OpenGroup&);
+    void keepFragment(const juce::String&, FragmentMap&);
+
+    void writeSnapshotElement(
+        juce::OutputStream&,
+        const SVGNode&,
+        FragmentMap&,
+        juce::StringArray *groupKeys
+    );
+
+    void writeSnapshotTag(
+        juce::OutputStream&,
+        const SVGNode&,
+        FragmentMap&,
+        juce::StringArray *groupKeys
+    );
+
+    juce::Array<OpenGroup> openGroups;
+    juce::HashMap<juce::String, int> groupKeyCounts;
+    juce::HashMap<juce::String, juce::uint64> groupHashes;
+
+    SnapshotCache *snapshotCache = nullptr;
+
+    // Hashes every drawing call, for looking whole documents up in the result
+    // cache. Group hashes forward to it, so it sees the calls made in groups.
+    SVGResultCache *resultCache = nullptr;
+    OpHash documentHash;
+
+    // Bumped whenever the renderer's output changes for the same drawing, so
+    // that documents cached by an older version aren't reused
+    static constexpr int resultCacheVersion = 1;
+
+    // Images whose encoding is put off until writeSnapshot() knows that the
+    // document isn't cached
+    struct PendingImage
+    {
+        SVGNode *element;
+        juce::Image image;
+        bool isMask;
+    };
+
+    juce::Array<PendingImage> pendingImages;
+
+    void encodePendingImages();
+    void writeDocument(juce::OutputStream&);
+
+    static constexpr const char* snapshotKeyAttribute   = "data-snapshot-key";
+    static constexpr const char* snapshotReuseAttribute = "data-snapshot-reuse";
+
     juce::OwnedArray<SavedState> stateStack;
     SavedState* state;
 
@@ -443,6 +1215,133 @@ private:
 
     juce::Graphics::ResamplingQuality resampleQuality;
 
-    juce::XmlElement *document;
+    bool downsampleImages;
+    float imageOversampling;
+
+    float pathTolerance;
+
+    PrecisionPolicy precision;
+    float canvasSize;   // the larger of the document's width and height
+
+    // A UI only uses a handful of colours and opacities, so their strings are
+    // formatted once and shared by every element that uses them
+    static constexpr int maxCachedColours = 256;
+
+    juce::HashMap<int, juce::String> colourStrings;    // keyed on 0xrrggbb
+    juce::String opacityStrings[256];                   // indexed by 8-bit alpha
+
+    // Per-operation temporaries (e.g. the buffers behind writePath()), freed
+    // all at once with the renderer
+    SVGArena scratch;
+
+    std::unique_ptr<ImageCodecPolicy> codecPolicy;
+    EncodedImageCache *encodedImageCache = nullptr;
+
+    // Embedded <image> refs keyed on the source image hash and encoded size
+    juce::HashMap<juce::String, juce::String> imageRefs;
+
+    // <mask> refs keyed on the mask image ref and its placement
+    juce::HashMap<juce::String, juce::String> maskRefs;
+
+    // <pattern> refs keyed on the tiled image ref and its placement
+    juce::HashMap<juce::String, juce::String> patternRefs;
+
+    // Elements that an opaque rectangle can remove, with their bounds in
+    // document coordinates, for each container that they were drawn into
+    struct CoveredElement
+    {
+        SVGNode *element;
+        juce::Rectangle<float> bounds;
+        int indexEntry;
+    };
+
+    // Elements are bucketed by the grid cell that their top left corner is
+    // in, since only an area containing that corner can cover them
+    struct Coverage
+    {
+        SVGNode *container;
+        juce::HashMap<juce::int64, juce::Array<CoveredElement>> cells;
+    };
+
+    struct ContainerHash
+    {
+        int generateHash(const SVGNode *e, int upperLimit) const noexcept
+        {
+            return (int)(((juce::pointer_sized_uint)e >> 4) % (juce::pointer_sized_uint)upperLimit);
+        }
+    };
+
+    static constexpr float coverageCellSize = 128.0f;
+
+    // Only containers that some saved state still draws into are tracked
+    juce::OwnedArray<Coverage> coverage;
+    juce::HashMap<const SVGNode*, Coverage*, ContainerHash> coverageByContainer;
+
+    static int getCoverageIndex(float position);
+    static juce::int64 getCoverageCell(int column, int row);
+    void removeCoveredElements(
+        juce::Array<CoveredElement>&,
+        const juce::Rectangle<float> &area,
+        SVGNode *container
+    );
+    void pruneCoverage();
+    void clearCoverage();
+
+    // Children of the document (or its defs) that can be spilled to disk
+    juce::int64 memoryBudget;
+    juce::int64 finishedBytes;
+
+    juce::Array<SVGNode*> unfinishedChildren;
+    juce::Array<SVGNode*> finishedChildren;
+
+    std::unique_ptr<juce::TemporaryFile> spillFile;
+    std::unique_ptr<juce::FileOutputStream> spillStream;
+    juce::InputStream *spillInput = nullptr;
+
+    static constexpr const char* spillPlaceholderTag = "juce-vector-spilled";
+
+    void noteFinished(SVGNode *topLevelChild);
+    void spillFinishedContent();
+    void spillChildren(
+        SVGNode &parent,
+        const juce::SortedSet<const SVGNode*> &finished
+    );
+
+    int numDefs;
+
+    // Spatial index entries in drawing order, with each grid cell listing the
+    // entries that overlap it. Removed elements leave a null entry behind.
+    struct IndexEntry
+    {
+        SVGNode *element;
+        juce::Rectangle<float> bounds;
+        bool hasBounds;
+    };
+
+    bool indexElements;
+    float indexCellSize;
+    int indexColumns, indexRows;
+
+    juce::Array<IndexEntry> indexEntries;
+    juce::Array<juce::Array<int>> indexCells;
+    juce::Array<int> unboundedEntries;
+
+    juce::Range<int> getIndexCells(float start, float end, int numCells) const;
+    void copyRegion(
+        const SVGNode &source,
+        juce::XmlElement &dest,
+        const juce::SortedSet<const SVGNode*>&,
+        juce::Array<const SVGNode*> &defs
+    ) const;
+
+    static void findRefs(const SVGNode&, juce::SortedSet<juce::String>&);
+    static void findRefs(const juce::XmlElement&, juce::SortedSet<juce::String>&);
+    static void addRef(const juce::String &value, juce::SortedSet<juce::String>&);
+
+    juce::XmlElement *output;
+
+    // Every node of the document, which are all freed with the renderer
+    SVGNode::Pool nodes;
+    SVGNode *document;
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LowLevelGraphicsSVGRenderer)
 };
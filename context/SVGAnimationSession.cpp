@@ -0,0 +1,481 @@
+/*
+    Copyright 2018 Antonio Lassandro
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+SVGAnimationSession::SVGAnimationSession(
+    int totalWidth,
+    int totalHeight,
+    double duration)
+    : sharedDefs("defs")
+{
+    jassert(duration > 0.0);
+
+    width  = totalWidth;
+    height = totalHeight;
+
+    frameDuration  = duration;
+    animationStyle = AnimationStyle::smil;
+
+    numFrames = 0;
+}
+
+SVGAnimationSession::~SVGAnimationSession()
+{
+    // The renderer refers to the frame document, so it has to go first
+    frameRenderer.reset();
+}
+
+#pragma mark -
+// =============================================================================
+
+LowLevelGraphicsSVGRenderer& SVGAnimationSession::beginFrame()
+{
+    jassert(frameRenderer == nullptr);  // endFrame() wasn't called!
+
+    frameDocument.reset(new juce::XmlElement("svg"));
+    frameRenderer.reset(
+        new LowLevelGraphicsSVGRenderer(frameDocument.get(), width, height)
+    );
+
+    return *frameRenderer;
+}
+
+void SVGAnimationSession::endFrame()
+{
+    jassert(frameRenderer != nullptr);  // beginFrame() wasn't called!
+
+    frameRenderer.reset();
+
+    RefMap renames;
+    mergeDefs(frameDocument->getChildByName("defs"), renames);
+
+    for (auto e = frameDocument->getFirstChildElement(); e; e = e->getNextElement())
+        if (!e->hasTagName("defs"))
+            renameRefs(e, renames);
+
+    mergeChildren(root, *frameDocument, numFrames);
+    ++numFrames;
+
+    frameDocument.reset();
+}
+
+int SVGAnimationSession::getNumFrames() const
+{
+    return numFrames;
+}
+
+#pragma mark -
+// =============================================================================
+
+void SVGAnimationSession::setAnimationStyle(AnimationStyle style)
+{
+    animationStyle = style;
+}
+
+void SVGAnimationSession::createDocument(juce::XmlElement *svgDocument) const
+{
+    jassert(svgDocument->getTagName().toLowerCase() == "svg");
+    jassert(svgDocument->getNumChildElements() == 0);
+
+    svgDocument->setAttribute("xmlns", "http://www.w3.org/2000/svg");
+    svgDocument->setAttribute("xmlns:xlink", "http://www.w3.org/1999/xlink");
+
+    svgDocument->setAttribute("width", width);
+    svgDocument->setAttribute("height", height);
+
+    svgDocument->addChildElement(new juce::XmlElement(sharedDefs));
+
+    StyleSheet styles;
+
+    for (auto node : root.children)
+        writeNode(*node, svgDocument, styles);
+
+    if (styles.rules.size() > 0)
+    {
+        auto style = new juce::XmlElement("style");
+        style->addTextElement(styles.rules.joinIntoString("\n"));
+
+        svgDocument->insertChildElement(style, 1);
+    }
+}
+
+#pragma mark -
+// =============================================================================
+
+void SVGAnimationSession::mergeDefs(juce::XmlElement *frameDefs, RefMap &renames)
+{
+    if (!frameDefs)
+        return;
+
+    // Defs only refer to defs created before them, so renaming in order makes
+    // every reference inside a def final before its content is compared
+    for (auto def = frameDefs->getFirstChildElement(); def; def = def->getNextElement())
+    {
+        renameRefs(def, renames);
+
+        auto id  = def->getStringAttribute("id");
+        auto key = getDefContentKey(*def);
+
+        if (!defsByContent.contains(key))
+        {
+            auto shared = new juce::XmlElement(*def);
+            shared->setAttribute(
+                "id",
+                id.trimCharactersAtEnd("0123456789")
+                    + juce::String(sharedDefs.getNumChildElements())
+            );
+
+            sharedDefs.addChildElement(shared);
+            defsByContent.set(key, shared->getStringAttribute("id"));
+        }
+
+        renames.set(id, defsByContent[key]);
+    }
+}
+
+void SVGAnimationSession::mergeChildren(
+    Node &parent,
+    const juce::XmlElement &element,
+    int frame)
+{
+    // Children are matched in order, so elements keep their stacking order
+    // relative to everything they were drawn with
+    int cursor = 0;
+
+    for (auto child = element.getFirstChildElement(); child; child = child->getNextElement())
+    {
+        if (child->isTextElement() || child->hasTagName("defs"))
+            continue;
+
+        auto key = getNodeKey(*child);
+        Node *node = nullptr;
+
+        for (int i = cursor; i < parent.children.size(); ++i)
+        {
+            auto candidate = parent.children.getUnchecked(i);
+
+            if (candidate->key == key && candidate->frames.getLast() != frame)
+            {
+                node   = candidate;
+                cursor = i + 1;
+                break;
+            }
+        }
+
+        if (!node)
+        {
+            node = parent.children.insert(cursor++, new Node());
+            node->key     = key;
+            node->tagName = child->getTagName();
+
+            if (!child->hasTagName("g"))
+                node->prototype.reset(new juce::XmlElement(*child));
+        }
+
+        juce::StringPairArray attributes(false);
+
+        for (int i = 0; i < child->getNumAttributes(); ++i)
+            attributes.set(child->getAttributeName(i), child->getAttributeValue(i));
+
+        node->frames.add(frame);
+        node->attributes.add(attributes);
+
+        if (child->hasTagName("g"))
+            mergeChildren(*node, *child, frame);
+    }
+}
+
+#pragma mark -
+// =============================================================================
+
+void SVGAnimationSession::writeNode(
+    const Node &node,
+    juce::XmlElement *parent,
+    StyleSheet &styles) const
+{
+    auto e = node.prototype
+        ? new juce::XmlElement(*node.prototype)
+        : new juce::XmlElement(node.tagName);
+
+    e->removeAllAttributes();
+    parent->addChildElement(e);
+
+    juce::StringArray cssAnimations;
+
+    auto &names = node.attributes.getReference(0).getAllKeys();
+
+    for (auto &name : names)
+    {
+        // Frames that the node isn't part of hold on to the previous value
+        // since the node is hidden for them anyway
+        juce::StringArray frameValues;
+        auto value = node.attributes.getReference(0)[name];
+
+        for (int f = 0, i = 0; f < numFrames; ++f)
+        {
+            if (i < node.frames.size() && node.frames[i] == f)
+                value = node.attributes.getReference(i++)[name];
+
+            frameValues.add(value);
+        }
+
+        e->setAttribute(name, frameValues[node.frames.getFirst()]);
+
+        for (auto &v : frameValues)
+        {
+            if (v != frameValues[0])
+            {
+                addAnimation(e, name, frameValues, cssAnimations, styles);
+                break;
+            }
+        }
+    }
+
+    if (node.frames.size() < numFrames)
+    {
+        auto useCSS = animationStyle == AnimationStyle::css;
+
+        juce::String attribute = useCSS ? "visibility" : "display";
+        juce::String visible   = useCSS ? "visible"    : "inline";
+        juce::String hidden    = useCSS ? "hidden"     : "none";
+
+        juce::StringArray frameValues;
+
+        for (int f = 0; f < numFrames; ++f)
+            frameValues.add(node.frames.contains(f) ? visible : hidden);
+
+        if (node.frames.getFirst() != 0)
+            e->setAttribute(attribute, hidden);
+
+        addAnimation(e, attribute, frameValues, cssAnimations, styles);
+    }
+
+    if (cssAnimations.size() > 0)
+    {
+        auto className = "f" + juce::String(styles.numAnimations++);
+
+        e->setAttribute("class", className);
+        styles.rules.add(
+            "." + className + "{animation:"
+                + cssAnimations.joinIntoString(",") + "}"
+        );
+    }
+
+    for (auto child : node.children)
+        writeNode(*child, e, styles);
+}
+
+void SVGAnimationSession::addAnimation(
+    juce::XmlElement *e,
+    const juce::String &attributeName,
+    const juce::StringArray &frameValues,
+    juce::StringArray &cssAnimations,
+    StyleSheet &styles) const
+{
+    // Only the frames where the value changes are written out
+    juce::StringArray values, keyTimes;
+
+    for (int f = 0; f < frameValues.size(); ++f)
+    {
+        if (f == 0 || frameValues[f] != frameValues[f - 1])
+        {
+            values.add(frameValues[f]);
+            keyTimes.add(formatNumber((double)f / frameValues.size()));
+        }
+    }
+
+    auto duration = formatNumber(frameValues.size() * frameDuration) + "s";
+
+    if (animationStyle == AnimationStyle::css && isCSSProperty(attributeName))
+    {
+        auto name = "k" + juce::String(styles.numAnimations++);
+        juce::String keyframes = "@keyframes " + name + "{";
+
+        for (int i = 0; i < values.size(); ++i)
+            keyframes << formatNumber(keyTimes[i].getDoubleValue() * 100.0)
+                      << "%{" << attributeName << ":" << values[i] << "}";
+
+        keyframes << "}";
+
+        styles.rules.add(keyframes);
+        cssAnimations.add(name + " " + duration + " step-end infinite");
+        return;
+    }
+
+    // Viewers ignore <animate> on transforms, which need an <animateTransform>
+    // of a single type. Elements only match across frames when their
+    // transforms are of the same animatable type (see getNodeKey()).
+    auto transformType = attributeName == "transform"
+        ? getTransformType(values[0])
+        : juce::String();
+
+    jassert(attributeName != "transform" || transformType.isNotEmpty());
+
+    auto animate = e->createNewChildElement(
+        transformType.isNotEmpty() ? "animateTransform" : "animate"
+    );
+
+    animate->setAttribute("attributeName", attributeName);
+
+    if (transformType.isNotEmpty())
+    {
+        animate->setAttribute("type", transformType);
+
+        for (auto &v : values)
+            v = v.fromFirstOccurrenceOf("(", false, false).upToLastOccurrenceOf(")", false, false);
+    }
+
+    if (attributeName.startsWith("xlink:"))
+        animate->setAttribute("attributeType", "XML");
+
+    animate->setAttribute("dur", duration);
+    animate->setAttribute("calcMode", "discrete");
+    animate->setAttribute("keyTimes", keyTimes.joinIntoString(";"));
+    animate->setAttribute("values", values.joinIntoString(";"));
+    animate->setAttribute("repeatCount", "indefinite");
+}
+
+#pragma mark -
+// =============================================================================
+
+bool SVGAnimationSession::isCSSProperty(const juce::String &name)
+{
+    return name == "fill"
+        || name == "fill-opacity"
+        || name == "stroke"
+        || name == "stroke-opacity"
+        || name == "opacity"
+        || name == "visibility";
+}
+
+juce::String SVGAnimationSession::getTransformType(const juce::String &transform)
+{
+    // Only a lone translate() or scale() can be driven by <animateTransform>,
+    // which has no matrix() type and animates one function at a time
+    for (auto type : { "translate", "scale" })
+    {
+        if (transform.startsWith(juce::String(type) + "(")
+            && transform.indexOfChar(')') == transform.length() - 1)
+            return type;
+    }
+
+    return {};
+}
+
+juce::String SVGAnimationSession::getNodeKey(const juce::XmlElement &e)
+{
+    juce::String key = e.getTagName();
+
+    // Elements only match when they have the same set of attributes, so every
+    // attribute has a value to animate from in every frame. Values that can't
+    // be written into a SMIL value list have to match as well.
+    for (int i = 0; i < e.getNumAttributes(); ++i)
+    {
+        auto name  = e.getAttributeName(i);
+        auto value = e.getAttributeValue(i);
+
+        key << "|" << name;
+
+        // Transforms can only be animated between values of the same single
+        // type, so any other transform has to match exactly
+        if (name == "transform")
+        {
+            auto type = getTransformType(value);
+            key << "=" << (type.isNotEmpty() ? type : value);
+        }
+        else if (value.containsChar(';'))
+        {
+            key << "=" << value;
+        }
+    }
+
+    if (e.hasTagName("g"))
+    {
+        // Groups match on their ID, or on the clip or mask that they apply
+        key << "|" << e.getStringAttribute("id")
+            << "|" << e.getStringAttribute("clip-path")
+            << "|" << e.getStringAttribute("mask");
+    }
+    else
+    {
+        // Text and other content can't be animated, so it has to match
+        juce::String content;
+
+        for (auto child = e.getFirstChildElement(); child; child = child->getNextElement())
+            content << (child->isTextElement()
+                ? child->getText()
+                : child->createDocument(juce::String(), true, false));
+
+        key << "|" << juce::String::toHexString(content.hashCode64())
+            << "|" << content.length();
+    }
+
+    return key;
+}
+
+juce::String SVGAnimationSession::getDefContentKey(const juce::XmlElement &def)
+{
+    juce::XmlElement copy(def);
+    copy.removeAttribute("id");
+
+    auto content = copy.createDocument(juce::String(), true, false);
+
+    return juce::String::toHexString(content.hashCode64())
+        + "_" + juce::String(content.length());
+}
+
+juce::String SVGAnimationSession::formatNumber(double value)
+{
+    auto string = juce::String(value, 4);
+
+    while (string.getLastCharacters(1) == "." ||
+          (string.getLastCharacters(1) == "0" && string.contains(".")))
+            string = string.dropLastCharacters(1);
+
+    return string;
+}
+
+void SVGAnimationSession::renameRefs(juce::XmlElement *e, const RefMap &renames)
+{
+    for (int i = 0; i < e->getNumAttributes(); ++i)
+    {
+        auto value = e->getAttributeValue(i);
+
+        // References are either an xlink:href="#id" or a url(#id)
+        juce::String id;
+
+        if (value.startsWithChar('#'))
+            id = value.substring(1);
+        else if (value.startsWith("url(#"))
+            id = value.fromFirstOccurrenceOf("#", false, false)
+                      .upToFirstOccurrenceOf(")", false, false);
+
+        if (id.isNotEmpty() && renames.contains(id))
+            e->setAttribute(
+                e->getAttributeName(i),
+                value.replace("#" + id, "#" + renames[id])
+            );
+    }
+
+    for (auto child = e->getFirstChildElement(); child; child = child->getNextElement())
+        if (!child->isTextElement())
+            renameRefs(child, renames);
+}
@@ -0,0 +1,176 @@
+/*
+    Copyright 2018 Antonio Lassandro
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#pragma once
+
+// =============================================================================
+/**
+    Renders a sequence of frames with LowLevelGraphicsSVGRenderer and combines
+    them into a single animated SVG document.
+
+    Each frame is drawn into its own renderer. Once a frame is finished its
+    defs are merged into one shared <defs> element (identical defs are only
+    kept once), and its elements are matched against the elements of earlier
+    frames by their group ID and content. Elements that look the same in every
+    frame are written once, and anything that differs between frames is driven
+    by discrete SMIL <animate> elements (or CSS keyframes, where possible).
+    Transforms are driven by <animateTransform>, which only moves between a
+    lone translate() or scale() in every frame. Elements with other changing
+    transforms aren't matched, and are shown and hidden frame by frame.
+
+    @code
+    SVGAnimationSession session(getWidth(), getHeight(), 1.0 / 30.0);
+
+    for (int i = 0; i < numFrames; ++i)
+    {
+        Graphics g(session.beginFrame());
+        paintFrame(g, i);
+        session.endFrame();
+    }
+
+    XmlElement svg("svg");
+    session.createDocument(&svg);
+    @endcode
+*/
+// =============================================================================
+class SVGAnimationSession
+{
+public:
+    /** How changing attributes are animated.
+    */
+    enum class AnimationStyle
+    {
+        /** <animate> elements for every changing attribute. */
+        smil,
+
+        /** CSS keyframes for visibility and presentation attributes (fill,
+            stroke, opacity), and SMIL for geometry and transforms, whose SVG
+            syntax CSS doesn't share.
+        */
+        css
+    };
+
+    /** Creates a session.
+
+        @param totalWidth    the width of every frame
+        @param totalHeight   the height of every frame
+        @param frameDuration the time each frame is shown for, in seconds
+    */
+    SVGAnimationSession(int totalWidth, int totalHeight, double frameDuration);
+
+    ~SVGAnimationSession();
+
+    #pragma mark -
+    // =========================================================================
+
+    /** Starts a new frame and returns the renderer to draw it with.
+
+        The renderer stays valid until endFrame() is called.
+    */
+    LowLevelGraphicsSVGRenderer& beginFrame();
+
+    /** Finishes the current frame and merges it into the animation.
+    */
+    void endFrame();
+
+    /** Returns the number of frames finished so far.
+    */
+    int getNumFrames() const;
+
+    #pragma mark -
+    // =========================================================================
+
+    /** Sets how changing attributes are animated.
+
+        The default is AnimationStyle::smil.
+    */
+    void setAnimationStyle(AnimationStyle);
+
+    /** Writes the animation into an empty <svg> element.
+    */
+    void createDocument(juce::XmlElement *svgDocument) const;
+
+#pragma mark -
+// =============================================================================
+private:
+    struct Node
+    {
+        juce::String key;
+        juce::String tagName;
+
+        // The first occurrence, including any children of leaf elements
+        std::unique_ptr<juce::XmlElement> prototype;
+
+        // The frames the node appears in, and its attributes in each of them
+        juce::Array<int> frames;
+        juce::Array<juce::StringPairArray> attributes;
+
+        juce::OwnedArray<Node> children;
+    };
+
+    struct StyleSheet
+    {
+        juce::StringArray rules;
+        int numAnimations = 0;
+    };
+
+    using RefMap = juce::HashMap<juce::String, juce::String>;
+
+    void mergeDefs(juce::XmlElement *frameDefs, RefMap &renames);
+    void mergeChildren(Node&, const juce::XmlElement&, int frame);
+
+    void writeNode(const Node&, juce::XmlElement *parent, StyleSheet&) const;
+
+    void addAnimation(
+        juce::XmlElement*,
+        const juce::String &attributeName,
+        const juce::StringArray &frameValues,
+        juce::StringArray &cssAnimations,
+        StyleSheet&
+    ) const;
+
+    static bool isCSSProperty(const juce::String&);
+    static juce::String getTransformType(const juce::String&);
+    static juce::String getNodeKey(const juce::XmlElement&);
+    static juce::String getDefContentKey(const juce::XmlElement&);
+    static juce::String formatNumber(double);
+    static void renameRefs(juce::XmlElement*, const RefMap &renames);
+
+    #pragma mark -
+    // =========================================================================
+
+    int width, height;
+    double frameDuration;
+    AnimationStyle animationStyle;
+
+    int numFrames;
+
+    std::unique_ptr<juce::XmlElement> frameDocument;
+    std::unique_ptr<LowLevelGraphicsSVGRenderer> frameRenderer;
+
+    juce::XmlElement sharedDefs;
+    RefMap defsByContent;
+
+    Node root;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SVGAnimationSession)
+};
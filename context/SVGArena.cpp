@@ -0,0 +1,113 @@
+/*
+    Copyright 2018 Antonio Lassandro
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+SVGArena::SVGArena(size_t size)
+{
+    jassert(size > 0);
+    blockSize = size;
+}
+
+void* SVGArena::allocate(size_t numBytes, size_t alignment)
+{
+    // Blocks come from malloc(), so only offsets need to be aligned
+    jassert(alignment > 0 && (alignment & (alignment - 1)) == 0);
+    jassert(alignment <= alignof(std::max_align_t));
+
+    if (currentBlock < blocks.size())
+    {
+        auto *block = blocks.getUnchecked(currentBlock);
+        auto start  = (offset + alignment - 1) & ~(alignment - 1);
+
+        if (start + numBytes <= block->size)
+        {
+            offset        = start + numBytes;
+            highWaterMark = juce::jmax(highWaterMark, bytesBefore + offset);
+
+            return block->data.getData() + start;
+        }
+
+        bytesBefore += block->size;
+        ++currentBlock;
+    }
+
+    // Blocks left over from earlier use are reused when they're big enough,
+    // otherwise a new one is put in front of them
+    if (currentBlock >= blocks.size()
+        || blocks.getUnchecked(currentBlock)->size < numBytes)
+    {
+        auto *block = new Block();
+        block->size = juce::jmax(blockSize, numBytes);
+        block->data.malloc(block->size);
+
+        blocks.insert(currentBlock, block);
+    }
+
+    offset        = numBytes;
+    highWaterMark = juce::jmax(highWaterMark, bytesBefore + offset);
+
+    return blocks.getUnchecked(currentBlock)->data.getData();
+}
+
+void SVGArena::reset()
+{
+    currentBlock = 0;
+    offset       = 0;
+    bytesBefore  = 0;
+}
+
+size_t SVGArena::getBytesInUse() const
+{
+    return bytesBefore + offset;
+}
+
+size_t SVGArena::getHighWaterMark() const
+{
+    return highWaterMark;
+}
+
+size_t SVGArena::getBytesReserved() const
+{
+    size_t total = 0;
+
+    for (auto *block : blocks)
+        total += block->size;
+
+    return total;
+}
+
+#pragma mark -
+// =============================================================================
+
+SVGArena::ScopedRewind::ScopedRewind(SVGArena &a)
+    : arena(a),
+      block(a.currentBlock),
+      offset(a.offset),
+      bytesBefore(a.bytesBefore)
+{
+}
+
+SVGArena::ScopedRewind::~ScopedRewind()
+{
+    arena.currentBlock = block;
+    arena.offset       = offset;
+    arena.bytesBefore  = bytesBefore;
+}
@@ -0,0 +1,117 @@
+/*
+    Copyright 2018 Antonio Lassandro
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#pragma once
+
+// =============================================================================
+/**
+    A block allocator for short lived, trivially destructible data.
+
+    Allocations are carved out of large blocks and are never freed on their
+    own: the arena is either rewound to an earlier position with a
+    ScopedRewind, or reset as a whole. Blocks are kept for reuse until the
+    arena is destroyed, so a renderer that keeps one arena for its scratch
+    buffers stops allocating once it has seen its largest operation.
+*/
+// =============================================================================
+class SVGArena
+{
+public:
+
+    /** Creates an empty arena. No memory is allocated until it's needed.
+    */
+    explicit SVGArena(size_t blockSize = 64 * 1024);
+
+    /** Returns a block of memory that stays valid until the arena is rewound
+        past it or reset.
+    */
+    void* allocate(size_t numBytes, size_t alignment = sizeof(double));
+
+    /** Returns uninitialised space for an array of objects.
+    */
+    template <typename Type>
+    Type* allocateArray(size_t numElements)
+    {
+        static_assert(std::is_trivially_destructible<Type>::value,
+                      "Objects in the arena are never destroyed");
+
+        return static_cast<Type*>(allocate(sizeof(Type) * numElements, alignof(Type)));
+    }
+
+    /** Makes everything allocated so far available for reuse, while keeping
+        the blocks that have been allocated.
+    */
+    void reset();
+
+    /** Returns the number of bytes currently in use.
+    */
+    size_t getBytesInUse() const;
+
+    /** Returns the largest number of bytes that have been in use at once.
+    */
+    size_t getHighWaterMark() const;
+
+    /** Returns the number of bytes held by the arena's blocks.
+    */
+    size_t getBytesReserved() const;
+
+    #pragma mark -
+    // =========================================================================
+
+    /** Rewinds the arena to where it was when this object was created, freeing
+        everything allocated in between.
+    */
+    class ScopedRewind
+    {
+    public:
+        ScopedRewind(SVGArena&);
+        ~ScopedRewind();
+
+    private:
+        SVGArena &arena;
+
+        const int block;
+        const size_t offset;
+        const size_t bytesBefore;
+
+        JUCE_DECLARE_NON_COPYABLE(ScopedRewind)
+    };
+
+private:
+
+    struct Block
+    {
+        juce::HeapBlock<char> data;
+        size_t size;
+    };
+
+    juce::OwnedArray<Block> blocks;
+
+    int currentBlock   = 0;
+    size_t offset      = 0;     // into the current block
+    size_t bytesBefore = 0;     // in use in the blocks before the current one
+
+    size_t blockSize;
+    size_t highWaterMark = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(SVGArena)
+};
@@ -0,0 +1,94 @@
+/*
+    Copyright 2018 Antonio Lassandro
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+SVGDefsLibrary::SVGDefsLibrary(const juce::String &libraryURL)
+: url(libraryURL)
+{
+    jassert(url.isNotEmpty());
+}
+
+const juce::String& SVGDefsLibrary::getURL() const
+{
+    return url;
+}
+
+bool SVGDefsLibrary::contains(const juce::String &id) const
+{
+    const juce::ScopedLock sl(lock);
+    return ids.contains(id);
+}
+
+bool SVGDefsLibrary::add(juce::XmlElement *def)
+{
+    std::unique_ptr<juce::XmlElement> owned(def);
+
+    auto id = def->getStringAttribute("id");
+    jassert(id.isNotEmpty());
+
+    const juce::ScopedLock sl(lock);
+
+    // Another renderer got there first with the same content
+    if (ids.contains(id))
+        return false;
+
+    // Definitions arrive in whatever order the renderers finish them, so
+    // they're kept in ID order to make the library the same from run to run
+    ids.add(id);
+    defs.insert(ids.indexOf(id), owned.release());
+    return true;
+}
+
+int SVGDefsLibrary::getNumDefs() const
+{
+    const juce::ScopedLock sl(lock);
+    return defs.size();
+}
+
+void SVGDefsLibrary::createDocument(juce::XmlElement *svgDocument) const
+{
+    jassert(svgDocument->getTagName().toLowerCase() == "svg");
+    jassert(svgDocument->getNumChildElements() == 0);
+
+    svgDocument->setAttribute("xmlns", "http://www.w3.org/2000/svg");
+    svgDocument->setAttribute("xmlns:xlink", "http://www.w3.org/1999/xlink");
+
+    auto libraryDefs = svgDocument->createNewChildElement("defs");
+
+    const juce::ScopedLock sl(lock);
+
+    for (auto def : defs)
+        libraryDefs->addChildElement(new juce::XmlElement(*def));
+}
+
+bool SVGDefsLibrary::writeToFile(const juce::File &file) const
+{
+    juce::XmlElement svg("svg");
+    createDocument(&svg);
+
+    SVGMappedFileOutputStream out(file);
+
+    if (!out.openedOk())
+        return false;
+
+    svg.writeToStream(out, juce::String());
+    return out.finish();
+}
@@ -0,0 +1,113 @@
+/*
+    Copyright 2018 Antonio Lassandro
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#pragma once
+
+// =============================================================================
+/**
+    A set of definitions shared by many documents, written once as a separate
+    "sprite sheet" SVG.
+
+    Renderers given the library (see
+    LowLevelGraphicsSVGRenderer::setDefsLibrary()) move their embedded images
+    into it and refer to them as "<url>#<id>", so a batch of snapshots that
+    draw the same icons only stores and encodes each icon once. IDs are
+    derived from content, so the same image gets the same ID in every
+    document, and an image that's already in the library isn't encoded again.
+
+    Only images are shared: they're referenced with <use> elements, which can
+    point into another document, whereas url() references to gradients,
+    clip paths and masks can't be relied on to.
+
+    A library can be shared between renderers on different threads.
+
+    @code
+    SVGDefsLibrary library("library.svg");
+
+    for (auto &snapshot : snapshots)
+    {
+        XmlElement svg("svg");
+        LowLevelGraphicsSVGRenderer renderer(&svg, width, height);
+        renderer.setDefsLibrary(&library);
+
+        Graphics g(renderer);
+        snapshot.paint(g);
+
+        svg.writeToFile(snapshot.file, String());
+    }
+
+    library.writeToFile(directory.getChildFile("library.svg"));
+    @endcode
+*/
+// =============================================================================
+class SVGDefsLibrary
+{
+public:
+    /** Creates an empty library.
+
+        @param url where documents will find the library, relative to
+                   themselves (e.g. "library.svg")
+    */
+    explicit SVGDefsLibrary(const juce::String &url);
+
+    /** Returns the URL that documents refer to the library with.
+    */
+    const juce::String& getURL() const;
+
+    /** Returns true if a definition with the ID is in the library.
+    */
+    bool contains(const juce::String &id) const;
+
+    /** Adds a definition, keyed on its "id" attribute, and takes ownership of
+        it.
+
+        Returns false (and deletes the definition) if there's already one with
+        the same ID.
+    */
+    bool add(juce::XmlElement *def);
+
+    /** Returns the number of definitions in the library.
+    */
+    int getNumDefs() const;
+
+    /** Writes the library into an empty <svg> element, with its definitions
+        sorted by ID.
+    */
+    void createDocument(juce::XmlElement *svgDocument) const;
+
+    /** Writes the library to a file.
+
+        @returns true if the file was written
+    */
+    bool writeToFile(const juce::File&) const;
+
+#pragma mark -
+// =============================================================================
+private:
+    juce::String url;
+
+    juce::CriticalSection lock;
+    juce::OwnedArray<juce::XmlElement> defs;    // in the same order as ids
+    juce::SortedSet<juce::String> ids;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SVGDefsLibrary)
+};
@@ -0,0 +1,598 @@
+/*
+    Copyright 2018 Antonio Lassandro
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+void SVGKernels::extractAlpha(
+    const juce::uint8 *source,
+    juce::uint8 *dest,
+    int numPixels,
+    juce::Image::PixelFormat format)
+{
+    if (format == juce::Image::SingleChannel)
+    {
+        memcpy(dest, source, (size_t)numPixels);
+        return;
+    }
+
+    if (format != juce::Image::ARGB)
+    {
+        memset(dest, 0xff, (size_t)numPixels);
+        return;
+    }
+
+    int i = 0;
+
+   #if JUCE_VECTOR_USE_SSE2
+    // Pixels are stored as 32-bit words with alpha in the top byte, so
+    // shifting each word down by 24 bits leaves the alpha values that then
+    // get packed down to bytes, 16 pixels at a time
+    for (; i + 16 <= numPixels; i += 16)
+    {
+        auto in = reinterpret_cast<const __m128i*>(source + i * 4);
+
+        auto a0 = _mm_srli_epi32(_mm_loadu_si128(in + 0), 24);
+        auto a1 = _mm_srli_epi32(_mm_loadu_si128(in + 1), 24);
+        auto a2 = _mm_srli_epi32(_mm_loadu_si128(in + 2), 24);
+        auto a3 = _mm_srli_epi32(_mm_loadu_si128(in + 3), 24);
+
+        auto packed = _mm_packus_epi16(
+            _mm_packs_epi32(a0, a1),
+            _mm_packs_epi32(a2, a3)
+        );
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), packed);
+    }
+   #elif JUCE_VECTOR_USE_NEON
+    for (; i + 16 <= numPixels; i += 16)
+    {
+        auto channels = vld4q_u8(source + i * 4);
+        vst1q_u8(dest + i, channels.val[juce::PixelARGB::indexA]);
+    }
+   #endif
+
+    for (; i < numPixels; ++i)
+        dest[i] = source[i * 4 + juce::PixelARGB::indexA];
+}
+
+juce::MemoryBlock SVGKernels::getAlphaPlane(const juce::Image &image)
+{
+    const juce::Image::BitmapData bitmap(
+        image,
+        0, 0,
+        image.getWidth(), image.getHeight()
+    );
+
+    juce::MemoryBlock plane((size_t)(bitmap.width * bitmap.height));
+    auto dest = static_cast<juce::uint8*>(plane.getData());
+
+    for (int y = 0; y < bitmap.height; ++y)
+        extractAlpha(
+            bitmap.getLinePointer(y),
+            dest + y * bitmap.width,
+            bitmap.width,
+            bitmap.pixelFormat
+        );
+
+    return plane;
+}
+
+juce::uint32 SVGKernels::crc32(const void *data, size_t numBytes, juce::uint32 crc)
+{
+    struct Table
+    {
+        Table()
+        {
+            for (juce::uint32 n = 0; n < 256; ++n)
+            {
+                auto c = n;
+
+                for (int k = 0; k < 8; ++k)
+                    c = (c & 1) ? 0xedb88320u ^ (c >> 1) : (c >> 1);
+
+                values[n] = c;
+            }
+        }
+
+        juce::uint32 values[256];
+    };
+
+    static const Table table;
+
+    auto bytes = static_cast<const juce::uint8*>(data);
+    crc = ~crc;
+
+    for (size_t i = 0; i < numBytes; ++i)
+        crc = table.values[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+bool SVGKernels::writeGreyscalePNG(
+    const juce::uint8 *pixels,
+    int width,
+    int height,
+    juce::OutputStream &out)
+{
+    auto writeChunk = [&out](const char *type, const void *data, size_t size)
+    {
+        out.writeIntBigEndian((int)size);
+        out.write(type, 4);
+
+        if (size > 0)
+            out.write(data, size);
+
+        auto crc = crc32(type, 4);
+        crc = crc32(data, size, crc);
+
+        return out.writeIntBigEndian((int)crc);
+    };
+
+    const juce::uint8 signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    out.write(signature, sizeof(signature));
+
+    juce::MemoryOutputStream header;
+    header.writeIntBigEndian(width);
+    header.writeIntBigEndian(height);
+    header.writeByte(8);    // bit depth
+    header.writeByte(0);    // colour type: greyscale
+    header.writeByte(0);    // compression method
+    header.writeByte(0);    // filter method
+    header.writeByte(0);    // interlace method
+
+    writeChunk("IHDR", header.getData(), header.getDataSize());
+
+    juce::MemoryOutputStream compressed;
+
+    {
+        // Zero window bits gives the zlib wrapper that IDAT chunks expect
+        juce::GZIPCompressorOutputStream zlib(&compressed, 9, false, 0);
+
+        for (int y = 0; y < height; ++y)
+        {
+            zlib.writeByte(0);  // filter type: none
+            zlib.write(pixels + y * width, (size_t)width);
+        }
+    }
+
+    writeChunk("IDAT", compressed.getData(), compressed.getDataSize());
+
+    return writeChunk("IEND", nullptr, 0);
+}
+
+void SVGKernels::transformPoints(
+    const float *source,
+    float *dest,
+    int numPoints,
+    const juce::AffineTransform &t)
+{
+    int i = 0;
+
+   #if JUCE_VECTOR_USE_SSE2
+    // Each register holds two points as x0 y0 x1 y1. Multiplying it by
+    // (mat00, mat11) and a copy with x and y swapped by (mat01, mat10) gives
+    // both transformed coordinates without any horizontal operations.
+    auto diagonal     = _mm_setr_ps(t.mat00, t.mat11, t.mat00, t.mat11);
+    auto antiDiagonal = _mm_setr_ps(t.mat01, t.mat10, t.mat01, t.mat10);
+    auto translation  = _mm_setr_ps(t.mat02, t.mat12, t.mat02, t.mat12);
+
+    for (; i + 4 <= numPoints; i += 4)
+    {
+        auto p0 = _mm_loadu_ps(source + i * 2);
+        auto p1 = _mm_loadu_ps(source + i * 2 + 4);
+
+        auto s0 = _mm_shuffle_ps(p0, p0, _MM_SHUFFLE(2, 3, 0, 1));
+        auto s1 = _mm_shuffle_ps(p1, p1, _MM_SHUFFLE(2, 3, 0, 1));
+
+        p0 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p0, diagonal), _mm_mul_ps(s0, antiDiagonal)), translation);
+        p1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p1, diagonal), _mm_mul_ps(s1, antiDiagonal)), translation);
+
+        _mm_storeu_ps(dest + i * 2, p0);
+        _mm_storeu_ps(dest + i * 2 + 4, p1);
+    }
+   #elif JUCE_VECTOR_USE_NEON
+    const float diagonalValues[]     = { t.mat00, t.mat11, t.mat00, t.mat11 };
+    const float antiDiagonalValues[] = { t.mat01, t.mat10, t.mat01, t.mat10 };
+    const float translationValues[]  = { t.mat02, t.mat12, t.mat02, t.mat12 };
+
+    auto diagonal     = vld1q_f32(diagonalValues);
+    auto antiDiagonal = vld1q_f32(antiDiagonalValues);
+    auto translation  = vld1q_f32(translationValues);
+
+    for (; i + 4 <= numPoints; i += 4)
+    {
+        auto p0 = vld1q_f32(source + i * 2);
+        auto p1 = vld1q_f32(source + i * 2 + 4);
+
+        p0 = vmlaq_f32(vmlaq_f32(translation, p0, diagonal), vrev64q_f32(p0), antiDiagonal);
+        p1 = vmlaq_f32(vmlaq_f32(translation, p1, diagonal), vrev64q_f32(p1), antiDiagonal);
+
+        vst1q_f32(dest + i * 2, p0);
+        vst1q_f32(dest + i * 2 + 4, p1);
+    }
+   #endif
+
+    for (; i < numPoints; ++i)
+    {
+        auto x = source[i * 2];
+        auto y = source[i * 2 + 1];
+
+        dest[i * 2]     = t.mat00 * x + t.mat01 * y + t.mat02;
+        dest[i * 2 + 1] = t.mat10 * x + t.mat11 * y + t.mat12;
+    }
+}
+
+int SVGKernels::formatNumber(float value, int decimalPlaces, char *dest)
+{
+    // Numbers too large to scale into an int64 (or not finite) are rare
+    // enough to go through the C library
+    if (!(std::abs(value) < 1.0e9f))
+        return juce::jmin(std::snprintf(dest, maxNumberLength + 1, "%.9g", (double)value), maxNumberLength);
+
+    static const juce::int64 powersOfTen[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+
+    decimalPlaces = juce::jlimit(0, 6, decimalPlaces);
+
+    auto scale = powersOfTen[decimalPlaces];
+    auto units = (juce::int64)std::llround((double)value * (double)scale);
+
+    auto *d = dest;
+
+    if (units < 0)
+    {
+        *d++ = '-';
+        units = -units;
+    }
+
+    char digits[12];
+    int numDigits = 0;
+
+    for (auto whole = units / scale; numDigits == 0 || whole > 0; whole /= 10)
+        digits[numDigits++] = (char)('0' + whole % 10);
+
+    while (numDigits > 0)
+        *d++ = digits[--numDigits];
+
+    if (auto fraction = units % scale)
+    {
+        while (fraction % 10 == 0)
+        {
+            fraction /= 10;
+            --decimalPlaces;
+        }
+
+        *d++ = '.';
+
+        for (int n = decimalPlaces; --n >= 0;)
+        {
+            d[n] = (char)('0' + fraction % 10);
+            fraction /= 10;
+        }
+
+        d += decimalPlaces;
+    }
+
+    return (int)(d - dest);
+}
+
+#pragma mark -
+// =============================================================================
+
+namespace
+{
+    struct PathSimplifier
+    {
+        using Point = juce::Point<float>;
+
+        PathSimplifier(juce::Path &destPath, float maxError)
+            : dest(destPath), tolerance(maxError)
+        {
+        }
+
+        void addSubPath(juce::Array<Point> &subPath, bool closed)
+        {
+            points.swapWith(subPath);
+
+            if (closed && points.getLast() != points.getFirst())
+                points.add(points.getFirst());
+
+            if (points.size() < 2)
+                return;
+
+            findVertices();
+
+            dest.startNewSubPath(points.getFirst());
+
+            // Runs of vertices that turn smoothly are fitted together, so
+            // curves are only broken at real corners
+            for (int start = 0, end = 1; end < vertices.size(); ++end)
+            {
+                if (end == vertices.size() - 1 || !isSmooth(end))
+                {
+                    addRun(start, end);
+                    start = end;
+                }
+            }
+
+            if (closed)
+                dest.closeSubPath();
+        }
+
+    private:
+        // Iterative Douglas-Peucker, so that paths with hundreds of thousands
+        // of points can't overflow the stack
+        void findVertices()
+        {
+            juce::Array<bool> keep;
+            keep.insertMultiple(0, false, points.size());
+            keep.set(0, true);
+            keep.set(points.size() - 1, true);
+
+            juce::Array<std::pair<int, int>> spans;
+            spans.add({ 0, points.size() - 1 });
+
+            while (spans.size() > 0)
+            {
+                auto span = spans.removeAndReturn(spans.size() - 1);
+
+                int furthest = -1;
+                auto maxDistance = tolerance * tolerance;
+
+                for (int i = span.first + 1; i < span.second; ++i)
+                {
+                    auto distance = getDistanceSquaredToSegment(
+                        points.getReference(i),
+                        points.getReference(span.first),
+                        points.getReference(span.second)
+                    );
+
+                    if (distance > maxDistance)
+                    {
+                        furthest    = i;
+                        maxDistance = distance;
+                    }
+                }
+
+                if (furthest >= 0)
+                {
+                    keep.set(furthest, true);
+                    spans.add({ span.first, furthest });
+                    spans.add({ furthest, span.second });
+                }
+            }
+
+            vertices.clearQuick();
+
+            for (int i = 0; i < points.size(); ++i)
+                if (keep.getUnchecked(i))
+                    vertices.add(i);
+        }
+
+        void addRun(int start, int end)
+        {
+            // A cubic needs three points, so it only saves anything over
+            // three or more lines
+            if (end - start < 3)
+            {
+                for (int v = start + 1; v <= end; ++v)
+                    dest.lineTo(getVertex(v));
+
+                return;
+            }
+
+            if (!addCurve(start, end))
+            {
+                auto middle = (start + end) / 2;
+
+                addRun(start, middle);
+                addRun(middle, end);
+            }
+        }
+
+        // Fits a single cubic to every original point between two vertices
+        // with the least squares method from Schneider's "An Algorithm for
+        // Automatically Fitting Digitized Curves" (Graphics Gems, 1990)
+        bool addCurve(int start, int end)
+        {
+            auto first = vertices.getUnchecked(start);
+            auto last  = vertices.getUnchecked(end);
+
+            auto p0 = points.getReference(first);
+            auto p3 = points.getReference(last);
+
+            auto t1 = getTangent(start, true);
+            auto t2 = getTangent(end, false);
+
+            juce::Array<double> u;
+            u.add(0.0);
+
+            for (int i = first + 1; i <= last; ++i)
+                u.add(u.getLast() + points.getReference(i).getDistanceFrom(points.getReference(i - 1)));
+
+            auto length = u.getLast();
+
+            if (length <= 0.0)
+                return false;
+
+            double c00 = 0.0, c01 = 0.0, c11 = 0.0, x0 = 0.0, x1 = 0.0;
+
+            for (int i = first; i <= last; ++i)
+            {
+                auto t  = u.getReference(i - first) /= length;
+                auto mt = 1.0 - t;
+
+                auto b0 = mt * mt * mt;
+                auto b1 = 3.0 * t * mt * mt;
+                auto b2 = 3.0 * t * t * mt;
+                auto b3 = t * t * t;
+
+                auto a1 = t1 * (float)b1;
+                auto a2 = t2 * (float)b2;
+
+                auto residual = points.getReference(i)
+                    - p0 * (float)(b0 + b1)
+                    - p3 * (float)(b2 + b3);
+
+                c00 += a1.getDotProduct(a1);
+                c01 += a1.getDotProduct(a2);
+                c11 += a2.getDotProduct(a2);
+                x0  += a1.getDotProduct(residual);
+                x1  += a2.getDotProduct(residual);
+            }
+
+            auto chord = (double)p0.getDistanceFrom(p3);
+            auto det   = c00 * c11 - c01 * c01;
+
+            auto alpha1 = chord / 3.0;
+            auto alpha2 = chord / 3.0;
+
+            if (std::abs(det) > 1.0e-12)
+            {
+                auto a1 = (x0 * c11 - x1 * c01) / det;
+                auto a2 = (c00 * x1 - c01 * x0) / det;
+
+                if (a1 > chord * 1.0e-6 && a2 > chord * 1.0e-6)
+                {
+                    alpha1 = a1;
+                    alpha2 = a2;
+                }
+            }
+
+            auto p1 = p0 + t1 * (float)alpha1;
+            auto p2 = p3 + t2 * (float)alpha2;
+
+            auto maxError = tolerance * tolerance;
+
+            for (int i = first + 1; i < last; ++i)
+            {
+                auto t  = (float)u.getUnchecked(i - first);
+                auto mt = 1.0f - t;
+
+                auto onCurve = p0 * (mt * mt * mt)
+                    + p1 * (3.0f * t * mt * mt)
+                    + p2 * (3.0f * t * t * mt)
+                    + p3 * (t * t * t);
+
+                if (onCurve.getDistanceSquaredFrom(points.getReference(i)) > maxError)
+                    return false;
+            }
+
+            dest.cubicTo(p1, p2, p3);
+            return true;
+        }
+
+        Point getVertex(int v) const
+        {
+            return points.getReference(vertices.getUnchecked(v));
+        }
+
+        bool isSmooth(int v) const
+        {
+            if (v <= 0 || v >= vertices.size() - 1)
+                return false;
+
+            auto in  = getVertex(v) - getVertex(v - 1);
+            auto out = getVertex(v + 1) - getVertex(v);
+
+            // Anything turning by less than 30 degrees counts as smooth
+            auto dot = in.getDotProduct(out);
+            return dot > 0.0f
+                && dot * dot > 0.75f * in.getDotProduct(in) * out.getDotProduct(out);
+        }
+
+        // Returns the unit tangent at a vertex, pointing into the run that
+        // starts (or ends) there
+        Point getTangent(int v, bool isStart) const
+        {
+            Point tangent;
+
+            if (isSmooth(v))
+                tangent = getVertex(v + 1) - getVertex(v - 1);
+            else
+                tangent = getVertex(isStart ? v + 1 : v - 1) - getVertex(v);
+
+            if (!isStart && isSmooth(v))
+                tangent = -tangent;
+
+            auto length = tangent.getDistanceFromOrigin();
+            return length > 0.0f ? tangent / length : tangent;
+        }
+
+        static float getDistanceSquaredToSegment(Point p, Point a, Point b)
+        {
+            auto ab = b - a;
+            auto lengthSquared = ab.getDotProduct(ab);
+
+            if (lengthSquared <= 0.0f)
+                return p.getDistanceSquaredFrom(a);
+
+            auto t = juce::jlimit(0.0f, 1.0f, (p - a).getDotProduct(ab) / lengthSquared);
+            return p.getDistanceSquaredFrom(a + ab * t);
+        }
+
+        juce::Path &dest;
+        float tolerance;
+
+        juce::Array<Point> points;
+        juce::Array<int> vertices;
+    };
+}
+
+juce::Path SVGKernels::simplifyPath(const juce::Path &path, float tolerance)
+{
+    if (tolerance <= 0.0f)
+        return path;
+
+    juce::Path result;
+    result.setUsingNonZeroWinding(path.isUsingNonZeroWinding());
+
+    // A quarter of the tolerance goes to flattening curves and the rest to
+    // simplifying the flattened outline
+    PathSimplifier simplifier(result, tolerance * 0.75f);
+    juce::PathFlatteningIterator i(path, juce::AffineTransform(), tolerance * 0.25f);
+
+    juce::Array<juce::Point<float>> subPath;
+    bool closed = false;
+
+    while (i.next())
+    {
+        if (subPath.isEmpty())
+            subPath.add({ i.x1, i.y1 });
+
+        juce::Point<float> end(i.x2, i.y2);
+
+        if (end != subPath.getLast())
+            subPath.add(end);
+
+        closed = closed || i.closesSubPath;
+
+        if (i.isLastInSubpath())
+        {
+            simplifier.addSubPath(subPath, closed);
+            subPath.clearQuick();
+            closed = false;
+        }
+    }
+
+    if (subPath.size() > 0)
+        simplifier.addSubPath(subPath, closed);
+
+    return result;
+}
@@ -0,0 +1,108 @@
+/*
+    Copyright 2018 Antonio Lassandro
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+ #define JUCE_VECTOR_USE_SSE2 1
+ #include <emmintrin.h>
+#elif (defined(__ARM_NEON) || defined(__ARM_NEON__)) && JUCE_LITTLE_ENDIAN
+ #define JUCE_VECTOR_USE_NEON 1
+ #include <arm_neon.h>
+#endif
+
+// =============================================================================
+/**
+    Low level routines used by LowLevelGraphicsSVGRenderer on its hot paths.
+
+    Each routine has a scalar implementation and, where it pays off, an SSE2 or
+    NEON one that is selected at compile time.
+*/
+// =============================================================================
+namespace SVGKernels
+{
+    /** Copies the alpha channel of a row of pixels into a packed 8-bit buffer.
+
+        RGB pixels have no alpha channel and are written as fully opaque.
+    */
+    void extractAlpha(
+        const juce::uint8 *source,
+        juce::uint8 *dest,
+        int numPixels,
+        juce::Image::PixelFormat
+    );
+
+    /** Returns the alpha channel of an image as a packed, 8-bit plane.
+    */
+    juce::MemoryBlock getAlphaPlane(const juce::Image&);
+
+    /** Updates a running CRC-32 (as used by PNG chunks) with a block of data.
+    */
+    juce::uint32 crc32(const void*, size_t, juce::uint32 crc = 0);
+
+    /** Writes an 8-bit greyscale PNG from a packed plane of pixels.
+    */
+    bool writeGreyscalePNG(
+        const juce::uint8 *pixels,
+        int width,
+        int height,
+        juce::OutputStream&
+    );
+
+    /** Applies an AffineTransform to an array of packed x, y pairs.
+
+        The source and destination may be the same array.
+    */
+    void transformPoints(
+        const float *source,
+        float *dest,
+        int numPoints,
+        const juce::AffineTransform&
+    );
+
+    /** The longest text that formatNumber() writes, in characters.
+    */
+    constexpr int maxNumberLength = 17;
+
+    /** Writes a number with at most the given number of decimal places (0 to
+        6), dropping trailing zeros, and returns the number of characters
+        written.
+
+        The destination must have room for maxNumberLength characters plus a
+        terminating null, which may be written but isn't counted.
+    */
+    int formatNumber(float value, int decimalPlaces, char *dest);
+
+    /** Returns a simplified copy of a path that stays within a tolerance of
+        the original.
+
+        Curves are flattened, vertices that don't move the outline by more
+        than the tolerance are dropped (which also merges collinear segments),
+        and smooth runs of the remaining vertices are fitted back into cubic
+        curves where a single curve stays within the tolerance.
+
+        @param path      the path to simplify
+        @param tolerance the largest distance, in the path's own units, that
+                         the simplified outline may be from the original
+    */
+    juce::Path simplifyPath(const juce::Path &path, float tolerance);
+}
@@ -0,0 +1,163 @@
+/*
+    Copyright 2018 Antonio Lassandro
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+SVGMappedFileOutputStream::SVGMappedFileOutputStream(
+    const juce::File &f,
+    juce::int64 initialSize)
+: file(f)
+{
+    jassert(initialSize > 0);
+
+    if (file.exists() && !file.deleteFile())
+    {
+        failed = true;
+        return;
+    }
+
+    failed = !reserve(juce::jmax((juce::int64)1, initialSize));
+}
+
+SVGMappedFileOutputStream::~SVGMappedFileOutputStream()
+{
+    finish();
+}
+
+bool SVGMappedFileOutputStream::openedOk() const
+{
+    return mapping != nullptr;
+}
+
+bool SVGMappedFileOutputStream::finish()
+{
+    if (finished)
+        return !failed;
+
+    finished = true;
+
+    // Unmapping hands the written pages back to the file
+    mapping.reset();
+
+    juce::FileOutputStream out(file);
+
+    if (!out.openedOk() || !out.setPosition(length) || out.truncate().failed())
+        failed = true;
+
+    return !failed;
+}
+
+#pragma mark -
+// =============================================================================
+
+void SVGMappedFileOutputStream::flush()
+{
+    // Writes go straight into the mapping, so there's nothing buffered
+}
+
+bool SVGMappedFileOutputStream::setPosition(juce::int64 newPosition)
+{
+    if (newPosition < 0 || newPosition > length)
+        return false;
+
+    position = newPosition;
+    return true;
+}
+
+juce::int64 SVGMappedFileOutputStream::getPosition()
+{
+    return position;
+}
+
+bool SVGMappedFileOutputStream::write(const void *data, size_t numBytes)
+{
+    auto dest = prepareWrite(numBytes);
+
+    if (!dest)
+        return false;
+
+    std::memcpy(dest, data, numBytes);
+    return true;
+}
+
+bool SVGMappedFileOutputStream::writeRepeatedByte(juce::uint8 byte, size_t numBytes)
+{
+    auto dest = prepareWrite(numBytes);
+
+    if (!dest)
+        return false;
+
+    std::memset(dest, byte, numBytes);
+    return true;
+}
+
+#pragma mark -
+// =============================================================================
+
+bool SVGMappedFileOutputStream::reserve(juce::int64 size)
+{
+    if (size <= capacity && mapping)
+        return true;
+
+    mapping.reset();
+
+    {
+        // Seeking past the end and writing a byte grows the file without
+        // writing everything in between
+        juce::FileOutputStream out(file);
+
+        if (!out.openedOk() || !out.setPosition(size - 1) || !out.writeByte(0))
+            return false;
+    }
+
+    mapping.reset(new juce::MemoryMappedFile(file, juce::MemoryMappedFile::readWrite));
+
+    if (mapping->getData() == nullptr || (juce::int64)mapping->getSize() < size)
+    {
+        mapping.reset();
+        return false;
+    }
+
+    capacity = size;
+    return true;
+}
+
+char* SVGMappedFileOutputStream::prepareWrite(size_t numBytes)
+{
+    jassert(!finished);
+
+    if (failed || finished)
+        return nullptr;
+
+    auto end = position + (juce::int64)numBytes;
+
+    if (end > capacity && !reserve(juce::jmax(end, capacity * 2)))
+    {
+        failed = true;
+        return nullptr;
+    }
+
+    auto dest = static_cast<char*>(mapping->getData()) + position;
+
+    position = end;
+    length   = juce::jmax(length, position);
+
+    return dest;
+}
@@ -0,0 +1,103 @@
+/*
+    Copyright 2018 Antonio Lassandro
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#pragma once
+
+// =============================================================================
+/**
+    An output stream that writes a file through a memory mapping.
+
+    The file is mapped at an initial size and grown geometrically as data is
+    written, so serializing a large document costs a copy into the mapping
+    rather than a system call for every buffer of output. The file is
+    truncated to the data that was written once the stream is finished,
+    either with finish() or when it's deleted.
+
+    Any existing file is replaced. Until the stream is finished the file can
+    be larger than its content, with the rest filled with zeros.
+
+    @code
+    SVGMappedFileOutputStream out(file);
+    renderer.writeSnapshot(out);
+
+    if (!out.finish())
+        showError();
+    @endcode
+*/
+// =============================================================================
+class SVGMappedFileOutputStream : public juce::OutputStream
+{
+public:
+    /** Creates a stream that replaces a file.
+
+        @param file         the file to write
+        @param initialSize  the size the file is mapped at to begin with,
+                            which is doubled whenever it runs out
+    */
+    explicit SVGMappedFileOutputStream(
+        const juce::File &file,
+        juce::int64 initialSize = 1024 * 1024
+    );
+
+    /** Finishes the file, if finish() hasn't been called.
+    */
+    ~SVGMappedFileOutputStream();
+
+    /** Returns true if the file could be created and mapped.
+    */
+    bool openedOk() const;
+
+    /** Unmaps the file and truncates it to the data that was written.
+
+        Nothing can be written after this. Returns true if every write
+        succeeded and the file was truncated.
+    */
+    bool finish();
+
+    #pragma mark -
+    // =========================================================================
+
+    void flush() override;
+    bool setPosition(juce::int64) override;
+    juce::int64 getPosition() override;
+    bool write(const void*, size_t) override;
+    bool writeRepeatedByte(juce::uint8, size_t) override;
+
+#pragma mark -
+// =============================================================================
+private:
+    // Makes the mapping hold at least the given number of bytes
+    bool reserve(juce::int64 size);
+    char* prepareWrite(size_t numBytes);
+
+    juce::File file;
+    std::unique_ptr<juce::MemoryMappedFile> mapping;
+
+    juce::int64 capacity = 0;
+    juce::int64 position = 0;
+    juce::int64 length   = 0;   // the furthest position written to
+
+    bool failed   = false;
+    bool finished = false;
+
+    JUCE_DECLARE_NON_COPYABLE(SVGMappedFileOutputStream)
+};
@@ -0,0 +1,620 @@
+/*
+    Copyright 2018 Antonio Lassandro
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+SVGNode::SVGNode(Pool &p, const juce::Identifier *name)
+    : pool(&p),
+      tagName(name)
+{
+}
+
+juce::String SVGNode::getTagName() const
+{
+    return tagName ? tagName->toString() : juce::String();
+}
+
+bool SVGNode::hasTagName(juce::StringRef name) const
+{
+    return tagName && *tagName == name;
+}
+
+bool SVGNode::isTextElement() const
+{
+    return tagName == nullptr;
+}
+
+juce::StringRef SVGNode::getText() const
+{
+    return text ? juce::StringRef(juce::CharPointer_UTF8(text)) : juce::StringRef();
+}
+
+#pragma mark -
+// =============================================================================
+
+int SVGNode::getNumAttributes() const
+{
+    return numAttributes;
+}
+
+const juce::Identifier& SVGNode::getAttributeName(int index) const
+{
+    static const juce::Identifier none;
+
+    auto a = firstAttribute;
+
+    for (int i = 0; a && i < index; ++i)
+        a = a->next;
+
+    jassert(index >= 0 && a != nullptr);
+    return (index >= 0 && a) ? *a->name : none;
+}
+
+juce::StringRef SVGNode::getAttributeValue(int index) const
+{
+    auto a = firstAttribute;
+
+    for (int i = 0; a && i < index; ++i)
+        a = a->next;
+
+    jassert(index >= 0 && a != nullptr);
+    return (index >= 0 && a) ? juce::StringRef(juce::CharPointer_UTF8(a->value)) : juce::StringRef();
+}
+
+bool SVGNode::hasAttribute(juce::StringRef name) const
+{
+    return findAttribute(name) != nullptr;
+}
+
+juce::String SVGNode::getStringAttribute(juce::StringRef name) const
+{
+    if (auto a = findAttribute(name))
+        return juce::String::fromUTF8(a->value, (int)a->length);
+
+    return {};
+}
+
+int SVGNode::getIntAttribute(juce::StringRef name, int defaultReturnValue) const
+{
+    if (auto a = findAttribute(name))
+        return juce::String::fromUTF8(a->value, (int)a->length).getIntValue();
+
+    return defaultReturnValue;
+}
+
+void SVGNode::setAttribute(const juce::Identifier &name, const juce::String &value)
+{
+    setAttribute(name, value.toRawUTF8(), value.getNumBytesAsUTF8());
+}
+
+void SVGNode::setAttribute(const juce::Identifier &name, int value)
+{
+    char digits[16];
+    auto length = std::snprintf(digits, sizeof(digits), "%d", value);
+
+    setAttribute(name, digits, (size_t)length);
+}
+
+void SVGNode::setAttribute(
+    const juce::Identifier &name,
+    const char *value,
+    size_t length)
+{
+    jassert(!isTextElement());
+
+    // Interned names are unique to the pool, so they're compared by address
+    auto interned = pool->intern(name);
+    auto a = firstAttribute;
+
+    while (a && a->name != interned)
+        a = a->next;
+
+    if (!a)
+    {
+        a = pool->createAttribute(interned);
+
+        if (lastAttribute)
+            lastAttribute->next = a;
+        else
+            firstAttribute = a;
+
+        lastAttribute = a;
+        ++numAttributes;
+    }
+
+    pool->assignText(a->value, a->length, a->capacity, value, length);
+}
+
+SVGNode::Attribute* SVGNode::findAttribute(juce::StringRef name) const
+{
+    for (auto a = firstAttribute; a; a = a->next)
+        if (*a->name == name)
+            return a;
+
+    return nullptr;
+}
+
+#pragma mark -
+// =============================================================================
+
+SVGNode* SVGNode::getFirstChildElement() const
+{
+    return firstChild;
+}
+
+SVGNode* SVGNode::getNextElement() const
+{
+    return nextSibling;
+}
+
+SVGNode* SVGNode::getParentElement() const
+{
+    return parent;
+}
+
+int SVGNode::getNumChildElements() const
+{
+    return numChildren;
+}
+
+SVGNode* SVGNode::getChildElement(int index) const
+{
+    auto child = firstChild;
+
+    for (int i = 0; child && i < index; ++i)
+        child = child->nextSibling;
+
+    return index >= 0 ? child : nullptr;
+}
+
+SVGNode* SVGNode::getChildByName(juce::StringRef name) const
+{
+    for (auto child = firstChild; child; child = child->nextSibling)
+        if (child->hasTagName(name))
+            return child;
+
+    return nullptr;
+}
+
+SVGNode* SVGNode::createNewChildElement(const juce::Identifier &name)
+{
+    auto child = pool->createElement(name);
+    addChildElement(child);
+
+    return child;
+}
+
+void SVGNode::addChildElement(SVGNode *child)
+{
+    jassert(child && child->parent == nullptr && child->pool == pool);
+
+    child->parent          = this;
+    child->previousSibling = lastChild;
+    child->nextSibling     = nullptr;
+
+    if (lastChild)
+        lastChild->nextSibling = child;
+    else
+        firstChild = child;
+
+    lastChild = child;
+    ++numChildren;
+}
+
+void SVGNode::prependChildElement(SVGNode *child)
+{
+    jassert(child && child->parent == nullptr && child->pool == pool);
+
+    child->parent          = this;
+    child->previousSibling = nullptr;
+    child->nextSibling     = firstChild;
+
+    if (firstChild)
+        firstChild->previousSibling = child;
+    else
+        lastChild = child;
+
+    firstChild = child;
+    ++numChildren;
+}
+
+void SVGNode::addTextElement(const juce::String &t)
+{
+    addChildElement(pool->createTextElement(t));
+}
+
+void SVGNode::removeChildElement(SVGNode *child, bool shouldDeleteTheChild)
+{
+    jassert(child && child->parent == this);
+
+    unlink(child);
+
+    if (shouldDeleteTheChild)
+        pool->release(child);
+}
+
+void SVGNode::replaceChildElement(SVGNode *currentChild, SVGNode *newChild)
+{
+    jassert(currentChild && currentChild->parent == this);
+    jassert(newChild && newChild->parent == nullptr && newChild->pool == pool);
+
+    newChild->parent          = this;
+    newChild->previousSibling = currentChild->previousSibling;
+    newChild->nextSibling     = currentChild->nextSibling;
+
+    if (newChild->previousSibling)
+        newChild->previousSibling->nextSibling = newChild;
+    else
+        firstChild = newChild;
+
+    if (newChild->nextSibling)
+        newChild->nextSibling->previousSibling = newChild;
+    else
+        lastChild = newChild;
+
+    currentChild->parent = currentChild->previousSibling = currentChild->nextSibling = nullptr;
+    pool->release(currentChild);
+}
+
+void SVGNode::deleteAllChildElements()
+{
+    for (auto child = firstChild; child;)
+    {
+        auto next = child->nextSibling;
+
+        child->parent = nullptr;
+        pool->release(child);
+
+        child = next;
+    }
+
+    firstChild = lastChild = nullptr;
+    numChildren = 0;
+}
+
+void SVGNode::unlink(SVGNode *child)
+{
+    if (child->previousSibling)
+        child->previousSibling->nextSibling = child->nextSibling;
+    else
+        firstChild = child->nextSibling;
+
+    if (child->nextSibling)
+        child->nextSibling->previousSibling = child->previousSibling;
+    else
+        lastChild = child->previousSibling;
+
+    child->parent = child->previousSibling = child->nextSibling = nullptr;
+    --numChildren;
+}
+
+bool SVGNode::isEquivalentTo(
+    const SVGNode *other,
+    bool ignoreOrderOfAttributes) const
+{
+    if (other == this)
+        return true;
+
+    if (!other || isTextElement() != other->isTextElement())
+        return false;
+
+    if (isTextElement())
+        return textLength == other->textLength
+            && std::memcmp(text, other->text, textLength) == 0;
+
+    if (*tagName != *other->tagName
+        || numAttributes != other->numAttributes
+        || numChildren != other->numChildren)
+        return false;
+
+    auto b = other->firstAttribute;
+
+    for (auto a = firstAttribute; a; a = a->next, b = b->next)
+    {
+        auto match = ignoreOrderOfAttributes ? other->findAttribute(*a->name) : b;
+
+        if (!match
+            || *match->name != *a->name
+            || match->length != a->length
+            || std::memcmp(match->value, a->value, a->length) != 0)
+            return false;
+    }
+
+    for (auto c = firstChild, d = other->firstChild; c; c = c->nextSibling, d = d->nextSibling)
+        if (!c->isEquivalentTo(d, ignoreOrderOfAttributes))
+            return false;
+
+    return true;
+}
+
+#pragma mark -
+// =============================================================================
+
+juce::XmlElement* SVGNode::createXmlElement() const
+{
+    if (isTextElement())
+        return juce::XmlElement::createTextElement(
+            juce::String::fromUTF8(text, (int)textLength)
+        );
+
+    auto e = new juce::XmlElement(*tagName);
+    copyContentTo(*e);
+
+    return e;
+}
+
+void SVGNode::copyContentTo(juce::XmlElement &e) const
+{
+    for (auto a = firstAttribute; a; a = a->next)
+        e.setAttribute(*a->name, juce::String::fromUTF8(a->value, (int)a->length));
+
+    for (auto child = firstChild; child; child = child->nextSibling)
+        e.addChildElement(child->createXmlElement());
+}
+
+#pragma mark -
+// =============================================================================
+
+SVGNode::Pool::Pool(size_t blockSize)
+    : arena(blockSize)
+{
+}
+
+SVGNode::Pool::~Pool()
+{
+    // Everything else is in the arena's blocks
+    for (auto block = largeText; block;)
+    {
+        auto next = block->next;
+        std::free(block);
+        block = next;
+    }
+}
+
+SVGNode* SVGNode::Pool::createElement(const juce::Identifier &tagName)
+{
+    return createNode(intern(tagName));
+}
+
+SVGNode* SVGNode::Pool::createTextElement(const juce::String &t)
+{
+    auto node = createNode(nullptr);
+    assignText(node->text, node->textLength, node->textCapacity, t.toRawUTF8(), t.getNumBytesAsUTF8());
+
+    return node;
+}
+
+SVGNode* SVGNode::Pool::createNode(const juce::Identifier *tagName)
+{
+    void *memory;
+
+    if (freeNodes)
+    {
+        memory    = freeNodes;
+        freeNodes = freeNodes->nextSibling;
+    }
+    else
+    {
+        memory = arena.allocate(sizeof(SVGNode), alignof(SVGNode));
+    }
+
+    noteAllocated(sizeof(SVGNode));
+    return new (memory) SVGNode(*this, tagName);
+}
+
+void SVGNode::Pool::release(SVGNode *node)
+{
+    jassert(node && node->pool == this && node->parent == nullptr);
+
+    for (auto child = node->firstChild; child;)
+    {
+        auto next = child->nextSibling;
+
+        child->parent = nullptr;
+        release(child);
+
+        child = next;
+    }
+
+    for (auto a = node->firstAttribute; a;)
+    {
+        auto next = a->next;
+        releaseAttribute(a);
+        a = next;
+    }
+
+    releaseText(node->text, node->textCapacity);
+
+    // Nodes are trivially destructible, so a released one is only relinked
+    node->nextSibling = freeNodes;
+    freeNodes = node;
+
+    noteReleased(sizeof(SVGNode));
+}
+
+size_t SVGNode::Pool::getBytesInUse() const
+{
+    return bytesInUse;
+}
+
+size_t SVGNode::Pool::getHighWaterMark() const
+{
+    return highWaterMark;
+}
+
+size_t SVGNode::Pool::getBytesReserved() const
+{
+    return arena.getBytesReserved() + largeTextBytes;
+}
+
+const juce::Identifier* SVGNode::Pool::intern(const juce::Identifier &name)
+{
+    auto key = name.getCharPointer().getAddress();
+
+    if (auto interned = names[key])
+        return interned;
+
+    auto interned = internedNames.add(new juce::Identifier(name));
+    names.set(key, interned);
+
+    return interned;
+}
+
+SVGNode::Attribute* SVGNode::Pool::createAttribute(const juce::Identifier *name)
+{
+    Attribute *a;
+
+    if (freeAttributes)
+    {
+        a = freeAttributes;
+        freeAttributes = freeAttributes->next;
+    }
+    else
+    {
+        a = arena.allocateArray<Attribute>(1);
+    }
+
+    *a = { name, nullptr, 0, 0, nullptr };
+
+    noteAllocated(sizeof(Attribute));
+    return a;
+}
+
+void SVGNode::Pool::releaseAttribute(Attribute *a)
+{
+    releaseText(a->value, a->capacity);
+
+    a->next = freeAttributes;
+    freeAttributes = a;
+
+    noteReleased(sizeof(Attribute));
+}
+
+void SVGNode::Pool::assignText(
+    char *&buffer,
+    size_t &length,
+    size_t &capacity,
+    const char *source,
+    size_t numBytes)
+{
+    if (numBytes + 1 > capacity)
+    {
+        releaseText(buffer, capacity);
+        buffer = allocateText(numBytes + 1, capacity);
+    }
+
+    std::memcpy(buffer, source, numBytes);
+    buffer[numBytes] = 0;
+
+    length = numBytes;
+}
+
+char* SVGNode::Pool::allocateText(size_t numBytes, size_t &capacity)
+{
+    // Large text (e.g. embedded images) gets a block of its own, so that it
+    // can be given back as soon as it's released
+    if (numBytes > maxPooledText)
+    {
+        auto block = static_cast<LargeText*>(std::malloc(sizeof(LargeText) + numBytes));
+        jassert(block != nullptr);
+
+        block->previous = nullptr;
+        block->next     = largeText;
+        block->size     = numBytes;
+
+        if (largeText)
+            largeText->previous = block;
+
+        largeText = block;
+        largeTextBytes += numBytes;
+
+        capacity = numBytes;
+        noteAllocated(numBytes);
+
+        return reinterpret_cast<char*>(block + 1);
+    }
+
+    size_t size = minPooledText;
+    int sizeIndex = 0;
+
+    while (size < numBytes)
+    {
+        size <<= 1;
+        ++sizeIndex;
+    }
+
+    capacity = size;
+    noteAllocated(size);
+
+    if (auto entry = freeText[sizeIndex])
+    {
+        freeText[sizeIndex] = entry->next;
+        return reinterpret_cast<char*>(entry);
+    }
+
+    return static_cast<char*>(arena.allocate(size, alignof(FreeText)));
+}
+
+void SVGNode::Pool::releaseText(char *buffer, size_t capacity)
+{
+    if (!buffer)
+        return;
+
+    noteReleased(capacity);
+
+    if (capacity > maxPooledText)
+    {
+        auto block = reinterpret_cast<LargeText*>(buffer) - 1;
+
+        if (block->previous)
+            block->previous->next = block->next;
+        else
+            largeText = block->next;
+
+        if (block->next)
+            block->next->previous = block->previous;
+
+        largeTextBytes -= block->size;
+        std::free(block);
+
+        return;
+    }
+
+    int sizeIndex = 0;
+
+    for (auto size = minPooledText; size < capacity; size <<= 1)
+        ++sizeIndex;
+
+    auto entry = reinterpret_cast<FreeText*>(buffer);
+    entry->next = freeText[sizeIndex];
+    freeText[sizeIndex] = entry;
+}
+
+void SVGNode::Pool::noteAllocated(size_t numBytes)
+{
+    bytesInUse   += numBytes;
+    highWaterMark = juce::jmax(highWaterMark, bytesInUse);
+}
+
+void SVGNode::Pool::noteReleased(size_t numBytes)
+{
+    jassert(bytesInUse >= numBytes);
+    bytesInUse -= numBytes;
+}
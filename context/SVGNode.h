@@ -0,0 +1,286 @@
+/*
+    Copyright 2018 Antonio Lassandro
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#pragma once
+
+// =============================================================================
+/**
+    An element or text node of a document built by the renderer.
+
+    Nodes mirror the parts of juce::XmlElement that the renderer uses, but they
+    live in an SVGNode::Pool instead of being allocated one at a time. Their
+    attributes and text are kept in the pool too, as UTF-8, so building an
+    element costs no heap allocations once the pool has grown to fit the
+    document. Nodes are copied into juce::XmlElements when one is needed.
+
+    Attribute values and text are returned as juce::StringRefs into the pool,
+    which stay valid until the attribute is changed or the node is deleted.
+*/
+// =============================================================================
+class SVGNode
+{
+public:
+    class Pool;
+
+    /** Returns the element's tag name, or an empty string for text.
+    */
+    juce::String getTagName() const;
+
+    /** Returns true if the element has the given tag name.
+    */
+    bool hasTagName(juce::StringRef) const;
+
+    /** Returns true if this is a text node rather than an element.
+    */
+    bool isTextElement() const;
+
+    /** Returns the text of a text node.
+    */
+    juce::StringRef getText() const;
+
+    #pragma mark -
+    // =========================================================================
+
+    int getNumAttributes() const;
+    const juce::Identifier& getAttributeName(int index) const;
+    juce::StringRef getAttributeValue(int index) const;
+
+    bool hasAttribute(juce::StringRef name) const;
+
+    /** Returns an attribute's value, or an empty string if it isn't set.
+    */
+    juce::String getStringAttribute(juce::StringRef name) const;
+
+    /** Returns an attribute's value as an integer.
+    */
+    int getIntAttribute(juce::StringRef name, int defaultReturnValue = 0) const;
+
+    /** Adds an attribute, or replaces the value of an existing one.
+
+        Floating point values have to be formatted by the caller, rather than
+        being silently truncated to an int.
+    */
+    void setAttribute(const juce::Identifier &name, const juce::String &value);
+    void setAttribute(const juce::Identifier &name, int value);
+    void setAttribute(const juce::Identifier &name, double value) = delete;
+
+    #pragma mark -
+    // =========================================================================
+
+    SVGNode* getFirstChildElement() const;
+    SVGNode* getNextElement() const;
+    SVGNode* getParentElement() const;
+
+    int getNumChildElements() const;
+    SVGNode* getChildElement(int index) const;
+
+    /** Returns the first child element with the given tag name, if any.
+    */
+    SVGNode* getChildByName(juce::StringRef tagName) const;
+
+    /** Creates an element from the same pool and appends it.
+    */
+    SVGNode* createNewChildElement(const juce::Identifier &tagName);
+
+    /** Appends or prepends a node that has no parent.
+    */
+    void addChildElement(SVGNode*);
+    void prependChildElement(SVGNode*);
+
+    /** Appends a text node.
+    */
+    void addTextElement(const juce::String&);
+
+    /** Takes a child out of this element, and optionally deletes it.
+    */
+    void removeChildElement(SVGNode*, bool shouldDeleteTheChild);
+
+    /** Puts a node in place of a child, and deletes the child.
+    */
+    void replaceChildElement(SVGNode *currentChild, SVGNode *newChild);
+
+    /** Deletes every child.
+    */
+    void deleteAllChildElements();
+
+    /** Compares two nodes and their children, the way
+        juce::XmlElement::isEquivalentTo() does.
+    */
+    bool isEquivalentTo(const SVGNode*, bool ignoreOrderOfAttributes) const;
+
+    #pragma mark -
+    // =========================================================================
+
+    /** Returns a new juce::XmlElement copy of the node and its children, which
+        the caller owns.
+    */
+    juce::XmlElement* createXmlElement() const;
+
+    /** Copies the node's attributes and children into an element, whatever
+        the element's tag name is.
+    */
+    void copyContentTo(juce::XmlElement&) const;
+
+private:
+    struct Attribute
+    {
+        const juce::Identifier *name;
+        char *value;
+        size_t length, capacity;
+        Attribute *next;
+    };
+
+    SVGNode(Pool&, const juce::Identifier *tagName);
+
+    Attribute* findAttribute(juce::StringRef name) const;
+    void setAttribute(const juce::Identifier&, const char *value, size_t length);
+
+    void unlink(SVGNode*);
+
+    Pool *pool;
+    const juce::Identifier *tagName;    // nullptr for text nodes
+
+    Attribute *firstAttribute = nullptr;
+    Attribute *lastAttribute  = nullptr;
+    int numAttributes = 0;
+
+    char *text = nullptr;
+    size_t textLength = 0, textCapacity = 0;
+
+    SVGNode *parent          = nullptr;
+    SVGNode *firstChild      = nullptr;
+    SVGNode *lastChild       = nullptr;
+    SVGNode *previousSibling = nullptr;
+    SVGNode *nextSibling     = nullptr;
+    int numChildren = 0;
+
+    JUCE_DECLARE_NON_COPYABLE(SVGNode)
+};
+
+#pragma mark -
+// =============================================================================
+
+/**
+    Owns the memory of a tree of SVGNodes.
+
+    Nodes and attributes are carved out of an SVGArena's blocks, and their text
+    is rounded up to a power of two in size. Deleted nodes, attributes and text
+    go on free lists that later ones are taken from, so a document that has
+    parts of it removed (or spilled to disk) reuses their memory. Text too
+    large for the blocks is allocated on its own. Everything is freed in one go
+    when the pool is destroyed, without visiting the nodes.
+*/
+class SVGNode::Pool
+{
+public:
+    explicit Pool(size_t blockSize = 64 * 1024);
+    ~Pool();
+
+    /** Creates an element with no parent.
+    */
+    SVGNode* createElement(const juce::Identifier &tagName);
+
+    /** Creates a text node with no parent.
+    */
+    SVGNode* createTextElement(const juce::String&);
+
+    /** Deletes a node that has no parent, along with its children.
+    */
+    void release(SVGNode*);
+
+    /** Returns the number of bytes in use by nodes, attributes and text.
+    */
+    size_t getBytesInUse() const;
+
+    /** Returns the largest number of bytes that have been in use at once.
+    */
+    size_t getHighWaterMark() const;
+
+    /** Returns the number of bytes held by the pool, including those waiting
+        on free lists to be reused.
+    */
+    size_t getBytesReserved() const;
+
+private:
+    friend class SVGNode;
+
+    const juce::Identifier* intern(const juce::Identifier&);
+
+    SVGNode* createNode(const juce::Identifier *tagName);
+
+    Attribute* createAttribute(const juce::Identifier *name);
+    void releaseAttribute(Attribute*);
+
+    // Copies text into a buffer of the node's (reallocating it when it's too
+    // small), keeping it null terminated
+    void assignText(char *&buffer, size_t &length, size_t &capacity,
+                    const char *source, size_t numBytes);
+    char* allocateText(size_t numBytes, size_t &capacity);
+    void releaseText(char *buffer, size_t capacity);
+
+    void noteAllocated(size_t numBytes);
+    void noteReleased(size_t numBytes);
+
+    SVGArena arena;
+
+    SVGNode *freeNodes = nullptr;
+    Attribute *freeAttributes = nullptr;
+
+    struct FreeText
+    {
+        FreeText *next;
+    };
+
+    // Text of 16 bytes up to maxPooledText, in powers of two
+    static constexpr size_t minPooledText = 16;
+    static constexpr size_t maxPooledText = 4096;
+    static constexpr int numTextSizes = 9;
+
+    FreeText *freeText[numTextSizes] = {};
+
+    struct LargeText
+    {
+        LargeText *previous, *next;
+        size_t size;
+    };
+
+    LargeText *largeText = nullptr;
+    size_t largeTextBytes = 0;
+
+    size_t bytesInUse    = 0;
+    size_t highWaterMark = 0;
+
+    // Names are held here so that nodes can point at them. They're looked up
+    // by the address of their pooled text, which is unique to each name.
+    struct NameHash
+    {
+        int generateHash(const char *name, int upperLimit) const noexcept
+        {
+            return (int)(((juce::pointer_sized_uint)name >> 3) % (juce::pointer_sized_uint)upperLimit);
+        }
+    };
+
+    juce::OwnedArray<juce::Identifier> internedNames;
+    juce::HashMap<const char*, const juce::Identifier*, NameHash> names;
+
+    JUCE_DECLARE_NON_COPYABLE(Pool)
+};
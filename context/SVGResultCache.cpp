@@ -0,0 +1,189 @@
+/*
+    Copyright 2018 Antonio Lassandro
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+SVGResultCache::SVGResultCache(
+    const juce::File &dir,
+    juce::int64 maxBytes)
+: directory(dir),
+  maxTotalBytes(juce::jmax((juce::int64)0, maxBytes))
+{
+    auto result = directory.createDirectory();
+    jassert(result.wasOk());
+    juce::ignoreUnused(result);
+}
+
+bool SVGResultCache::read(juce::uint64 key, juce::OutputStream &out)
+{
+    auto file = getEntryFile(key);
+    juce::FileInputStream in(file);
+
+    if (!in.openedOk())
+    {
+        ++numMisses;
+        return false;
+    }
+
+    out.writeFromInputStream(in, -1);
+    ++numHits;
+
+    // The modification time doubles as the time the entry was last used
+    file.setLastModificationTime(juce::Time::getCurrentTime());
+    return true;
+}
+
+void SVGResultCache::write(
+    juce::uint64 key,
+    const void *data,
+    size_t numBytes)
+{
+    auto file = getEntryFile(key);
+    auto replacedBytes = file.getSize();
+
+    // Entries are written under another extension and then renamed, so
+    // readers in other processes only ever see complete entries
+    auto temp = file.withFileExtension(".tmp").getNonexistentSibling();
+
+    {
+        juce::FileOutputStream out(temp);
+
+        if (!out.openedOk() || !out.write(data, numBytes))
+        {
+            jassertfalse;
+            temp.deleteFile();
+            return;
+        }
+    }
+
+    if (!temp.moveFileTo(file))
+    {
+        jassertfalse;
+        temp.deleteFile();
+        return;
+    }
+
+    // The directory is only scanned once the running total goes over budget
+    // (or on the first write), rather than on every write
+    if (totalBytes >= 0)
+        totalBytes += (juce::int64)numBytes - replacedBytes;
+
+    if (maxTotalBytes > 0 && (totalBytes < 0 || totalBytes > maxTotalBytes))
+        trim();
+}
+
+bool SVGResultCache::contains(juce::uint64 key) const
+{
+    return getEntryFile(key).existsAsFile();
+}
+
+void SVGResultCache::clear()
+{
+    for (auto &file : getEntryFiles())
+        file.deleteFile();
+
+    totalBytes = 0;
+}
+
+juce::int64 SVGResultCache::getTotalBytes() const
+{
+    juce::int64 total = 0;
+
+    for (auto &file : getEntryFiles())
+        total += file.getSize();
+
+    return total;
+}
+
+int SVGResultCache::getNumHits() const
+{
+    return numHits;
+}
+
+int SVGResultCache::getNumMisses() const
+{
+    return numMisses;
+}
+
+juce::File SVGResultCache::getEntryFile(juce::uint64 key) const
+{
+    return directory.getChildFile(
+        juce::String::toHexString((juce::int64)key).paddedLeft('0', 16)
+        + entryExtension
+    );
+}
+
+juce::Array<juce::File> SVGResultCache::getEntryFiles() const
+{
+    return directory.findChildFiles(
+        juce::File::findFiles,
+        false,
+        juce::String("*") + entryExtension
+    );
+}
+
+void SVGResultCache::trim()
+{
+    if (maxTotalBytes == 0)
+        return;
+
+    struct Entry
+    {
+        juce::File file;
+        juce::int64 size;
+        juce::int64 lastUsed;
+    };
+
+    juce::Array<Entry> entries;
+    juce::int64 total = 0;
+
+    for (auto &file : getEntryFiles())
+    {
+        entries.add({ file, file.getSize(), file.getLastModificationTime().toMilliseconds() });
+        total += entries.getLast().size;
+    }
+
+    totalBytes = total;
+
+    if (total <= maxTotalBytes)
+        return;
+
+    struct LeastRecentlyUsedFirst
+    {
+        static int compareElements(const Entry &a, const Entry &b)
+        {
+            return a.lastUsed < b.lastUsed ? -1 : (a.lastUsed > b.lastUsed ? 1 : 0);
+        }
+    };
+
+    LeastRecentlyUsedFirst order;
+    entries.sort(order);
+
+    for (auto &entry : entries)
+    {
+        if (total <= maxTotalBytes)
+            break;
+
+        if (entry.file.deleteFile())
+            total -= entry.size;
+    }
+
+    totalBytes = total;
+}
@@ -0,0 +1,105 @@
+/*
+    Copyright 2018 Antonio Lassandro
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#pragma once
+
+// =============================================================================
+/**
+    An on-disk cache of finished SVG documents, keyed by the hash of the
+    drawing that produced them.
+
+    A renderer given a result cache (see
+    LowLevelGraphicsSVGRenderer::setResultCache()) hashes every drawing call
+    as it's made. When writeSnapshot() finds a document with the same hash in
+    the cache it copies the cached bytes instead of serializing again.
+
+    Each entry is a file in the cache's directory. Once the entries take up
+    more than the cache's budget, the least recently used ones are deleted.
+    The cache keeps a running total of the entries' size, and only scans the
+    directory when that total goes over budget, so entries added by other
+    processes are only counted at the next scan.
+    Entries are written to a temporary file first and then moved into place,
+    so several processes can share a directory.
+*/
+// =============================================================================
+class SVGResultCache
+{
+public:
+    /** Creates a cache that keeps its entries in a directory.
+
+        @param directory     where the entries are kept, created if needed
+        @param maxTotalBytes the size that the entries are trimmed to once
+                             they grow past it, or 0 for no limit
+    */
+    SVGResultCache(const juce::File &directory, juce::int64 maxTotalBytes);
+
+    /** Copies an entry to a stream, and marks it as recently used.
+
+        Returns false if there's no entry for the key.
+    */
+    bool read(juce::uint64 key, juce::OutputStream&);
+
+    /** Adds or replaces an entry, then deletes the least recently used
+        entries until the cache is back within its budget.
+    */
+    void write(juce::uint64 key, const void *data, size_t numBytes);
+
+    /** Returns true if there's an entry for the key.
+    */
+    bool contains(juce::uint64 key) const;
+
+    /** Deletes every entry.
+    */
+    void clear();
+
+    /** Returns the total size of the entries.
+    */
+    juce::int64 getTotalBytes() const;
+
+    /** Returns the number of read() calls that found an entry.
+    */
+    int getNumHits() const;
+
+    /** Returns the number of read() calls that didn't find an entry.
+    */
+    int getNumMisses() const;
+
+private:
+    juce::File getEntryFile(juce::uint64 key) const;
+    juce::Array<juce::File> getEntryFiles() const;
+
+    void trim();
+
+    juce::File directory;
+    juce::int64 maxTotalBytes;
+
+    // The entries' size as of the last scan, plus the writes since then, or
+    // -1 before the first scan
+    juce::int64 totalBytes = -1;
+
+    int numHits   = 0;
+    int numMisses = 0;
+
+    static constexpr const char* entryExtension = ".svg";
+
+    JUCE_DECLARE_NON_COPYABLE(SVGResultCache)
+};
@@ -0,0 +1,408 @@
+/*
+    Copyright 2018 Antonio Lassandro
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+// Epochs are shared by every cache in the process. Each reading thread
+// publishes the epoch it started reading in, and an entry that was unlinked
+// in an epoch can be deleted once every reader started in a later one.
+namespace SVGEpochs
+{
+    static constexpr int maxReaders = 256;
+
+    struct Slot
+    {
+        std::atomic<bool> claimed { false };
+        std::atomic<juce::uint64> epoch { 0 };  // 0 while not reading
+    };
+
+    static std::atomic<juce::uint64> globalEpoch { 1 };
+    static Slot slots[maxReaders];
+
+    // Readers that couldn't get a slot hold off every deletion instead
+    static std::atomic<int> numUnregisteredReaders { 0 };
+
+    // Claimed by a thread when it first reads, and given back when it exits
+    struct ThreadSlot
+    {
+        ThreadSlot()
+        {
+            for (int i = 0; i < maxReaders && index < 0; ++i)
+            {
+                auto expected = false;
+
+                if (slots[i].claimed.compare_exchange_strong(expected, true))
+                    index = i;
+            }
+        }
+
+        ~ThreadSlot()
+        {
+            if (index >= 0)
+                slots[index].claimed.store(false);
+        }
+
+        int index = -1;
+        int depth = 0;  // of nested ReadGuards
+    };
+
+    static ThreadSlot& getThreadSlot()
+    {
+        thread_local ThreadSlot slot;
+        return slot;
+    }
+
+    // Entries retired before the returned epoch can no longer be reached by
+    // any reader
+    static juce::uint64 getOldestReachableEpoch()
+    {
+        // Loaded first, so that readers that start during the scan are
+        // covered as well
+        auto oldest = globalEpoch.load();
+
+        if (numUnregisteredReaders.load() > 0)
+            return 0;
+
+        for (auto &slot : slots)
+        {
+            auto epoch = slot.epoch.load();
+
+            if (epoch != 0)
+                oldest = juce::jmin(oldest, epoch);
+        }
+
+        return oldest;
+    }
+}
+
+#pragma mark -
+// =============================================================================
+
+SVGSharedCacheBase::ReadGuard::ReadGuard()
+{
+    auto &thread = SVGEpochs::getThreadSlot();
+    slot = thread.index;
+
+    if (thread.depth++ > 0)
+        return;
+
+    if (slot < 0)
+    {
+        SVGEpochs::numUnregisteredReaders.fetch_add(1);
+        return;
+    }
+
+    SVGEpochs::slots[slot].epoch.store(SVGEpochs::globalEpoch.load());
+
+    // The epoch has to be visible before any entry is read
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+SVGSharedCacheBase::ReadGuard::~ReadGuard()
+{
+    auto &thread = SVGEpochs::getThreadSlot();
+
+    if (--thread.depth > 0)
+        return;
+
+    if (slot < 0)
+        SVGEpochs::numUnregisteredReaders.fetch_sub(1);
+    else
+        SVGEpochs::slots[slot].epoch.store(0, std::memory_order_release);
+}
+
+#pragma mark -
+// =============================================================================
+
+SVGSharedCacheBase::SVGSharedCacheBase(juce::int64 maxSize, int size)
+: maxBytes(maxSize),
+  numBuckets(juce::jmax(1, size))
+{
+    jassert(maxBytes > 0);
+    buckets.reset(new std::atomic<Entry*>[(size_t)numBuckets]());
+}
+
+SVGSharedCacheBase::~SVGSharedCacheBase()
+{
+    // Nothing can still be reading from a cache that's being deleted
+    for (int i = 0; i < numBuckets; ++i)
+    {
+        auto e = buckets[i].load();
+
+        while (e)
+        {
+            auto next = e->next.load();
+            delete e;
+            e = next;
+        }
+    }
+
+    while (retired)
+    {
+        auto next = retired->nextRetired;
+        delete retired;
+        retired = next;
+    }
+}
+
+juce::int64 SVGSharedCacheBase::getBytesInUse() const
+{
+    return bytesInUse.load(std::memory_order_relaxed);
+}
+
+int SVGSharedCacheBase::getNumEntries() const
+{
+    return numEntries.load(std::memory_order_relaxed);
+}
+
+juce::int64 SVGSharedCacheBase::getNumHits() const
+{
+    return numHits.load(std::memory_order_relaxed);
+}
+
+juce::int64 SVGSharedCacheBase::getNumMisses() const
+{
+    return numMisses.load(std::memory_order_relaxed);
+}
+
+void SVGSharedCacheBase::clear()
+{
+    for (int i = 0; i < numBuckets; ++i)
+    {
+        Entry *e;
+
+        {
+            const juce::SpinLock::ScopedLockType sl(getBucketLock(i));
+            e = buckets[i].exchange(nullptr, std::memory_order_acq_rel);
+        }
+
+        while (e)
+        {
+            // An unlinked entry's next pointer stays valid for readers
+            auto next = e->next.load(std::memory_order_relaxed);
+
+            bytesInUse -= (juce::int64)e->numBytes;
+            --numEntries;
+            retire(e);
+
+            e = next;
+        }
+    }
+
+    reclaim();
+}
+
+#pragma mark -
+// =============================================================================
+
+const SVGSharedCacheBase::Entry* SVGSharedCacheBase::findEntry(juce::uint64 key)
+{
+    auto e = buckets[getBucketIndex(key)].load(std::memory_order_acquire);
+
+    for (; e; e = e->next.load(std::memory_order_acquire))
+    {
+        if (e->key == key)
+        {
+            // Only written when it changes, to keep hot entries' cache lines
+            // from bouncing between readers
+            if (!e->referenced.load(std::memory_order_relaxed))
+                e->referenced.store(true, std::memory_order_relaxed);
+
+           #if JUCE_VECTOR_ENABLE_INSTRUMENTATION
+            numHits.fetch_add(1, std::memory_order_relaxed);
+           #endif
+
+            return e;
+        }
+    }
+
+   #if JUCE_VECTOR_ENABLE_INSTRUMENTATION
+    numMisses.fetch_add(1, std::memory_order_relaxed);
+   #endif
+
+    return nullptr;
+}
+
+void SVGSharedCacheBase::insertEntry(Entry *e)
+{
+    auto index = getBucketIndex(e->key);
+    Entry *replaced = nullptr;
+
+    // Once it's published the entry can be evicted by another thread at any
+    // time, so nothing is read from it afterwards
+    auto numBytes = (juce::int64)e->numBytes;
+
+    {
+        const juce::SpinLock::ScopedLockType sl(getBucketLock(index));
+
+        auto *link = &buckets[index];
+        auto current = link->load(std::memory_order_relaxed);
+
+        while (current && current->key != e->key)
+        {
+            link = &current->next;
+            current = link->load(std::memory_order_relaxed);
+        }
+
+        if (current)
+        {
+            e->next.store(current->next.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            replaced = current;
+        }
+        else
+        {
+            e->next.store(buckets[index].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            link = &buckets[index];
+        }
+
+        // Publishes the entry's contents along with it
+        link->store(e, std::memory_order_release);
+    }
+
+    bytesInUse += numBytes;
+    ++numEntries;
+
+    if (replaced)
+    {
+        bytesInUse -= (juce::int64)replaced->numBytes;
+        --numEntries;
+        retire(replaced);
+    }
+
+    if (bytesInUse.load() > maxBytes)
+        evict();
+
+    reclaim();
+}
+
+#pragma mark -
+// =============================================================================
+
+int SVGSharedCacheBase::getBucketIndex(juce::uint64 key) const
+{
+    return (int)((key ^ (key >> 32)) % (juce::uint64)numBuckets);
+}
+
+juce::SpinLock& SVGSharedCacheBase::getBucketLock(int bucket)
+{
+    return bucketLocks[bucket % numBucketLocks];
+}
+
+void SVGSharedCacheBase::retire(Entry *e)
+{
+    // Any reader that could have seen the entry started in this epoch or an
+    // earlier one
+    e->retiredEpoch = SVGEpochs::globalEpoch.fetch_add(1);
+
+    const juce::SpinLock::ScopedLockType sl(retiredLock);
+    e->nextRetired = retired;
+    retired = e;
+}
+
+void SVGSharedCacheBase::reclaim()
+{
+    auto oldest = SVGEpochs::getOldestReachableEpoch();
+    Entry *unreachable = nullptr;
+
+    {
+        const juce::SpinLock::ScopedLockType sl(retiredLock);
+
+        for (auto **link = &retired; *link;)
+        {
+            auto e = *link;
+
+            if (e->retiredEpoch < oldest)
+            {
+                *link = e->nextRetired;
+                e->nextRetired = unreachable;
+                unreachable = e;
+            }
+            else
+            {
+                link = &e->nextRetired;
+            }
+        }
+    }
+
+    while (unreachable)
+    {
+        auto next = unreachable->nextRetired;
+        delete unreachable;
+        unreachable = next;
+    }
+}
+
+void SVGSharedCacheBase::evict()
+{
+    // One thread evicting is enough, the others carry on
+    const juce::SpinLock::ScopedTryLockType tl(evictLock);
+
+    if (!tl.isLocked())
+        return;
+
+    // The clock hand clears the flag of entries that were used since it last
+    // passed them, and evicts the ones that weren't. Readers can keep setting
+    // flags behind it, so after two full turns entries are evicted whether
+    // they were used or not, which keeps the budget a hard limit.
+    for (int i = 0; i < numBuckets * 3 && bytesInUse.load() > maxBytes; ++i)
+    {
+        auto force = i >= numBuckets * 2;
+        auto index = clockHand;
+        clockHand = (clockHand + 1) % numBuckets;
+
+        juce::Array<Entry*> evicted;
+        auto excess = bytesInUse.load() - maxBytes;
+
+        {
+            const juce::SpinLock::ScopedLockType sl(getBucketLock(index));
+
+            auto *link = &buckets[index];
+
+            while (excess > 0)
+            {
+                auto current = link->load(std::memory_order_relaxed);
+
+                if (!current)
+                    break;
+
+                auto next = current->next.load(std::memory_order_relaxed);
+                auto wasReferenced = current->referenced.exchange(false, std::memory_order_relaxed);
+
+                if (force || !wasReferenced)
+                {
+                    link->store(next, std::memory_order_release);
+                    evicted.add(current);
+                    excess -= (juce::int64)current->numBytes;
+                }
+                else
+                {
+                    link = &current->next;
+                }
+            }
+        }
+
+        for (auto e : evicted)
+        {
+            bytesInUse -= (juce::int64)e->numBytes;
+            --numEntries;
+            retire(e);
+        }
+    }
+}
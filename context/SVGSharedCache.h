@@ -0,0 +1,216 @@
+/*
+    Copyright 2018 Antonio Lassandro
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#pragma once
+
+// =============================================================================
+/**
+    The thread-safe core of SVGSharedCache, which doesn't depend on the type of
+    value being cached.
+
+    Entries live in a fixed table of buckets, each a singly linked list that
+    readers walk without taking a lock. An entry is never changed once it's
+    published: replacing or evicting one unlinks it, and it's only deleted
+    once every reader that could have seen it has finished (epoch based
+    reclamation). Writers take a lock for the bucket they change, so writers
+    only contend when they hit the same bucket.
+
+    Once the entries take up more than the cache's budget, the least recently
+    used ones are evicted. Recency is tracked with a "referenced" flag per
+    entry that a clock hand sweeps over, which approximates LRU without
+    readers having to write anything shared beyond that flag.
+*/
+// =============================================================================
+class SVGSharedCacheBase
+{
+public:
+    /** Returns the approximate number of bytes held by the entries.
+    */
+    juce::int64 getBytesInUse() const;
+
+    /** Returns the number of entries.
+    */
+    int getNumEntries() const;
+
+    /** Returns the number of lookups that found an entry.
+
+        Lookups are only counted when JUCE_VECTOR_ENABLE_INSTRUMENTATION is
+        enabled, since every reader updating shared counters would make them
+        contend with each other.
+    */
+    juce::int64 getNumHits() const;
+
+    /** Returns the number of lookups that didn't find an entry (see
+        getNumHits()).
+    */
+    juce::int64 getNumMisses() const;
+
+    /** Evicts every entry.
+    */
+    void clear();
+
+#pragma mark -
+// =============================================================================
+protected:
+    struct Entry
+    {
+        virtual ~Entry() {}
+
+        juce::uint64 key = 0;
+        size_t numBytes = 0;
+
+        std::atomic<Entry*> next { nullptr };
+        std::atomic<bool> referenced { true };
+
+        // Set once the entry has been unlinked
+        juce::uint64 retiredEpoch = 0;
+        Entry *nextRetired = nullptr;
+    };
+
+    SVGSharedCacheBase(juce::int64 maxBytes, int numBuckets);
+    ~SVGSharedCacheBase();
+
+    /** Keeps the entries this thread can see from being deleted, for as long
+        as it exists.
+    */
+    class ReadGuard
+    {
+    public:
+        ReadGuard();
+        ~ReadGuard();
+
+    private:
+        int slot;
+
+        JUCE_DECLARE_NON_COPYABLE(ReadGuard)
+    };
+
+    // Must be called with a ReadGuard in scope
+    const Entry* findEntry(juce::uint64 key);
+
+    // Publishes a new entry, replacing any with the same key
+    void insertEntry(Entry*);
+
+private:
+    int getBucketIndex(juce::uint64 key) const;
+    juce::SpinLock& getBucketLock(int bucket);
+
+    void retire(Entry*);
+    void reclaim();
+    void evict();
+
+    juce::int64 maxBytes;
+
+    std::unique_ptr<std::atomic<Entry*>[]> buckets;
+    int numBuckets;
+
+    static constexpr int numBucketLocks = 64;
+    juce::SpinLock bucketLocks[numBucketLocks];
+
+    std::atomic<juce::int64> bytesInUse { 0 };
+    std::atomic<int> numEntries { 0 };
+
+    std::atomic<juce::int64> numHits   { 0 };
+    std::atomic<juce::int64> numMisses { 0 };
+
+    juce::SpinLock evictLock;
+    int clockHand = 0;
+
+    juce::SpinLock retiredLock;
+    Entry *retired = nullptr;
+
+    JUCE_DECLARE_NON_COPYABLE(SVGSharedCacheBase)
+};
+
+#pragma mark -
+// =============================================================================
+
+/**
+    A cache that renderers on any number of threads can share, keyed on 64 bit
+    hashes.
+
+    Lookups never take a lock, so many renderers can read the same cache
+    without slowing each other down. Values are copied in and out, so
+    ValueType should be cheap to copy (e.g. juce::String, which shares its
+    text).
+
+    @code
+    static LowLevelGraphicsSVGRenderer::EncodedImageCache images(256 * 1024 * 1024);
+
+    // on each exporter thread
+    renderer.setEncodedImageCache(&images);
+    @endcode
+*/
+template <typename ValueType>
+class SVGSharedCache : public SVGSharedCacheBase
+{
+public:
+    /** Creates an empty cache.
+
+        @param maxBytes   the approximate size that entries are evicted down
+                          to, as measured by the sizes given to set()
+        @param numBuckets the size of the hash table, which doesn't grow
+    */
+    explicit SVGSharedCache(juce::int64 maxBytes, int numBuckets = 4096)
+    : SVGSharedCacheBase(maxBytes, numBuckets)
+    {
+    }
+
+    /** Copies the value for a key into result, and returns false if there's
+        no entry for it.
+    */
+    bool get(juce::uint64 key, ValueType &result)
+    {
+        ReadGuard guard;
+
+        if (auto e = findEntry(key))
+        {
+            result = static_cast<const TypedEntry*>(e)->value;
+            return true;
+        }
+
+        return false;
+    }
+
+    /** Adds or replaces the value for a key.
+
+        @param numBytes the approximate memory the value uses
+    */
+    void set(juce::uint64 key, const ValueType &value, size_t numBytes)
+    {
+        auto e = new TypedEntry(value);
+        e->key = key;
+        e->numBytes = numBytes + sizeof(TypedEntry);
+
+        insertEntry(e);
+    }
+
+private:
+    struct TypedEntry : public Entry
+    {
+        TypedEntry(const ValueType &v) : value(v) {}
+
+        const ValueType value;
+    };
+
+    JUCE_DECLARE_NON_COPYABLE(SVGSharedCache)
+};
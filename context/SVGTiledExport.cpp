@@ -0,0 +1,175 @@
+/*
+    Copyright 2018 Antonio Lassandro
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+SVGTiledExport::SVGTiledExport(
+    int totalWidth,
+    int totalHeight,
+    int tileW,
+    int tileH)
+{
+    jassert(tileW > 0 && tileH > 0);
+
+    width  = totalWidth;
+    height = totalHeight;
+
+    tileWidth  = tileW;
+    tileHeight = tileH;
+
+    renderer.reset(new LowLevelGraphicsSVGRenderer(width, height));
+
+    // With cells no bigger than a tile, each tile only looks at the few cells
+    // underneath it
+    renderer->setSpatialIndexing(true, (float)juce::jmin(tileWidth, tileHeight));
+}
+
+LowLevelGraphicsSVGRenderer& SVGTiledExport::getRenderer()
+{
+    return *renderer;
+}
+
+#pragma mark -
+// =============================================================================
+
+int SVGTiledExport::getNumColumns() const
+{
+    return juce::jmax(1, (width + tileWidth - 1) / tileWidth);
+}
+
+int SVGTiledExport::getNumRows() const
+{
+    return juce::jmax(1, (height + tileHeight - 1) / tileHeight);
+}
+
+juce::Rectangle<int> SVGTiledExport::getTileBounds(int column, int row) const
+{
+    jassert(juce::isPositiveAndBelow(column, getNumColumns()));
+    jassert(juce::isPositiveAndBelow(row, getNumRows()));
+
+    return juce::Rectangle<int>(width, height).getIntersection({
+        column * tileWidth,
+        row * tileHeight,
+        tileWidth,
+        tileHeight
+    });
+}
+
+#pragma mark -
+// =============================================================================
+
+void SVGTiledExport::createTile(
+    int column,
+    int row,
+    juce::XmlElement *svgDocument,
+    const juce::String &sharedDefsURL) const
+{
+    renderer->extractRegion(
+        getTileBounds(column, row).toFloat(),
+        svgDocument,
+        sharedDefsURL.isEmpty()
+    );
+
+    if (sharedDefsURL.isEmpty())
+        return;
+
+    // Images are only ever referenced by <use> elements, which (unlike url()
+    // references) can point into another document. They're the only defs
+    // left out of the tile, so any <use> of a missing def shows one.
+    juce::SortedSet<juce::String> ids;
+
+    if (auto defs = svgDocument->getChildByName("defs"))
+        for (auto def = defs->getFirstChildElement(); def; def = def->getNextElement())
+            ids.add(def->getStringAttribute("id"));
+
+    juce::Array<juce::XmlElement*> elements;
+    elements.add(svgDocument);
+
+    while (elements.size() > 0)
+    {
+        auto e = elements.removeAndReturn(elements.size() - 1);
+
+        if (e->hasTagName("use"))
+        {
+            auto ref = e->getStringAttribute("xlink:href");
+
+            if (ref.startsWithChar('#') && !ids.contains(ref.substring(1)))
+                e->setAttribute("xlink:href", sharedDefsURL + ref);
+        }
+
+        for (auto child = e->getFirstChildElement(); child; child = child->getNextElement())
+            if (!child->isTextElement())
+                elements.add(child);
+    }
+}
+
+void SVGTiledExport::createSharedDefs(juce::XmlElement *svgDocument) const
+{
+    renderer->extractImages(svgDocument);
+}
+
+bool SVGTiledExport::writeToDirectory(const juce::File &directory) const
+{
+    if (directory.createDirectory().failed())
+        return false;
+
+    {
+        juce::XmlElement sharedDefs("svg");
+        createSharedDefs(&sharedDefs);
+
+        if (!writeDocument(sharedDefs, directory.getChildFile("defs.svg")))
+            return false;
+    }
+
+    // Tiles are created and written one at a time, so only one of them is
+    // ever held in memory
+    for (int row = 0; row < getNumRows(); ++row)
+    {
+        for (int column = 0; column < getNumColumns(); ++column)
+        {
+            juce::XmlElement tile("svg");
+            createTile(column, row, &tile, "defs.svg");
+
+            auto file = directory.getChildFile(
+                juce::String::formatted("tile_%d_%d.svg", column, row)
+            );
+
+            if (!writeDocument(tile, file))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+bool SVGTiledExport::writeDocument(
+    const juce::XmlElement &svgDocument,
+    const juce::File &file)
+{
+    // Tiles and shared defs can run to hundreds of megabytes, so they're
+    // serialized straight into a mapping of the file
+    SVGMappedFileOutputStream out(file);
+
+    if (!out.openedOk())
+        return false;
+
+    svgDocument.writeToStream(out, juce::String());
+    return out.finish();
+}
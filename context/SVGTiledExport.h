@@ -0,0 +1,123 @@
+/*
+    Copyright 2018 Antonio Lassandro
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to
+    deal in the Software without restriction, including without limitation the
+    rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+    sell copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in
+    all copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+    FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+    IN THE SOFTWARE.
+*/
+
+#pragma once
+
+// =============================================================================
+/**
+    Paints a very large canvas once and writes it out as a grid of smaller SVG
+    documents.
+
+    Everything is drawn into a single LowLevelGraphicsSVGRenderer with spatial
+    indexing enabled, so each tile only receives the elements whose bounds
+    overlap it (along with the groups and clips around them). Embedded images
+    can be written once to a shared document that every tile refers to, and
+    tiles are created one at a time so they can be streamed to disk.
+
+    @code
+    SVGTiledExport tiles(20000, 20000, 2000, 2000);
+
+    Graphics g(tiles.getRenderer());
+    paintTimeline(g);
+
+    tiles.writeToDirectory(outputDirectory);
+    @endcode
+*/
+// =============================================================================
+class SVGTiledExport
+{
+public:
+    /** Creates an export for a canvas of the given size.
+
+        @param totalWidth  the width of the whole canvas
+        @param totalHeight the height of the whole canvas
+        @param tileWidth   the width of each tile
+        @param tileHeight  the height of each tile
+    */
+    SVGTiledExport(int totalWidth, int totalHeight, int tileWidth, int tileHeight);
+
+    /** Returns the renderer that the whole canvas should be painted with.
+    */
+    LowLevelGraphicsSVGRenderer& getRenderer();
+
+    #pragma mark -
+    // =========================================================================
+
+    /** Returns the number of tile columns.
+    */
+    int getNumColumns() const;
+
+    /** Returns the number of tile rows.
+    */
+    int getNumRows() const;
+
+    /** Returns the area of the canvas that a tile covers.
+
+        Tiles in the last column and row are cropped to the canvas.
+    */
+    juce::Rectangle<int> getTileBounds(int column, int row) const;
+
+    #pragma mark -
+    // =========================================================================
+
+    /** Writes a single tile into an empty <svg> element.
+
+        @param column         the tile's column
+        @param row            the tile's row
+        @param svgDocument    an empty <svg> element
+        @param sharedDefsURL  if not empty, embedded images are left out of
+                              the tile and referred to in this document
+                              instead (see createSharedDefs())
+    */
+    void createTile(
+        int column,
+        int row,
+        juce::XmlElement *svgDocument,
+        const juce::String &sharedDefsURL = juce::String()
+    ) const;
+
+    /** Writes the images embedded in the canvas into an empty <svg> element,
+        for tiles created with a sharedDefsURL to refer to.
+    */
+    void createSharedDefs(juce::XmlElement *svgDocument) const;
+
+    /** Writes the shared defs and every tile to a directory.
+
+        The shared defs are written to "defs.svg" and each tile to
+        "tile_<column>_<row>.svg".
+
+        @returns true if every file was written
+    */
+    bool writeToDirectory(const juce::File &directory) const;
+
+#pragma mark -
+// =============================================================================
+private:
+    static bool writeDocument(const juce::XmlElement&, const juce::File&);
+
+    int width, height;
+    int tileWidth, tileHeight;
+
+    std::unique_ptr<LowLevelGraphicsSVGRenderer> renderer;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SVGTiledExport)
+};
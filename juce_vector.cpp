@@ -22,4 +22,15 @@
 
 #include "juce_vector.h"
 
+#include "context/SVGKernels.h"
+#include "context/SVGKernels.cpp"
+#include "context/SVGArena.cpp"
+#include "context/SVGNode.cpp"
+#include "context/SVGSharedCache.cpp"
+#include "context/SVGResultCache.cpp"
+#include "context/SVGMappedFileOutputStream.cpp"
+#include "context/SVGDefsLibrary.cpp"
+
 #include "context/LowLevelGraphicsSVGRenderer.cpp"
+#include "context/SVGAnimationSession.cpp"
+#include "context/SVGTiledExport.cpp"
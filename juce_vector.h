@@ -40,4 +40,23 @@
 
 #include <juce_graphics/juce_graphics.h>
 
+//==============================================================================
+/** Config: JUCE_VECTOR_ENABLE_INSTRUMENTATION
+
+    Enables per-operation call counters and timers in
+    LowLevelGraphicsSVGRenderer (see LowLevelGraphicsSVGRenderer::getStats()).
+    When disabled, the instrumentation is compiled out entirely.
+*/
+#ifndef JUCE_VECTOR_ENABLE_INSTRUMENTATION
+ #define JUCE_VECTOR_ENABLE_INSTRUMENTATION 0
+#endif
+
+#include "context/SVGArena.h"
+#include "context/SVGNode.h"
+#include "context/SVGSharedCache.h"
+#include "context/SVGResultCache.h"
+#include "context/SVGMappedFileOutputStream.h"
+#include "context/SVGDefsLibrary.h"
 #include "context/LowLevelGraphicsSVGRenderer.h"
+#include "context/SVGAnimationSession.h"
+#include "context/SVGTiledExport.h"